@@ -0,0 +1,242 @@
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <libtorrent/session.hpp>
+#include <libtorrent/create_torrent.hpp>
+#include <libtorrent/torrent_info.hpp>
+#include <libtorrent/alert_types.hpp>
+#include <libtorrent/bencode.hpp>
+#include <libtorrent/mmap_disk_io.hpp>
+#include <libtorrent/posix_disk_io.hpp>
+#include "../src/TorrentProfiles.hpp"
+
+struct BenchResult {
+    bool ok;
+    double seconds;
+    double cpuSeconds;
+    uint64_t diskWritten;
+};
+
+static double cpuSeconds() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static uint64_t diskWriteBytes() {
+    std::ifstream io("/proc/self/io");
+    std::string key;
+    uint64_t value;
+    while (io >> key >> value) {
+        if (key == "write_bytes:") return value;
+    }
+    return 0;
+}
+
+static void makeFile(const std::string& path, uint64_t size, uint64_t seed) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    std::mt19937_64 random(seed);
+    std::vector<char> block(1 << 20);
+    for (uint64_t written = 0; written < size; written += block.size()) {
+        for (size_t i = 0; i < block.size(); i += 8) *reinterpret_cast<uint64_t*>(&block[i]) = random();
+        out.write(block.data(), static_cast<std::streamsize>(std::min<uint64_t>(block.size(), size - written)));
+    }
+}
+
+static std::string makePayload(const std::string& dir, const std::string& layout, uint64_t size) {
+    std::string root = dir + "/src/" + layout;
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root);
+    if (layout == "single") {
+        makeFile(root + "/payload.bin", size, size);
+    } else {
+        int files = layout == "many" ? 64 : 512;
+        for (int i = 0; i < files; ++i) {
+            uint64_t share = size / files + (i % 7) * 4093;
+            std::string sub = root + "/part" + std::to_string(i % 8);
+            std::filesystem::create_directories(sub);
+            makeFile(sub + "/file" + std::to_string(i) + ".bin", share, size + i);
+        }
+    }
+    return root;
+}
+
+static std::string makeTorrent(const std::string& payload, int pieceSize) {
+    libtorrent::file_storage files;
+    libtorrent::add_files(files, payload);
+    libtorrent::create_torrent creator(files, pieceSize);
+    libtorrent::set_piece_hashes(creator, std::filesystem::path(payload).parent_path().string());
+    std::vector<char> encoded;
+    libtorrent::bencode(std::back_inserter(encoded), creator.generate());
+    std::string path = payload + "-" + std::to_string(pieceSize / 1024) + "k.torrent";
+    std::ofstream(path, std::ios::binary).write(encoded.data(), static_cast<std::streamsize>(encoded.size()));
+    return path;
+}
+
+static libtorrent::settings_pack loopbackSettings(libtorrent::settings_pack pack) {
+    using sp = libtorrent::settings_pack;
+    pack.set_str(sp::listen_interfaces, "127.0.0.1:0");
+    pack.set_bool(sp::enable_dht, false);
+    pack.set_bool(sp::enable_lsd, false);
+    pack.set_bool(sp::enable_upnp, false);
+    pack.set_bool(sp::enable_natpmp, false);
+    pack.set_bool(sp::allow_multiple_connections_per_ip, true);
+    pack.set_int(sp::alert_mask, libtorrent::alert_category::status | libtorrent::alert_category::error);
+    return pack;
+}
+
+static int waitForListenPort(libtorrent::session& session) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (std::chrono::steady_clock::now() < deadline) {
+        session.wait_for_alert(std::chrono::milliseconds(100));
+        std::vector<libtorrent::alert*> alerts;
+        session.pop_alerts(&alerts);
+        for (auto* alert : alerts) {
+            auto* listening = libtorrent::alert_cast<libtorrent::listen_succeeded_alert>(alert);
+            if (listening && listening->socket_type == libtorrent::socket_type_t::tcp) return listening->port;
+        }
+    }
+    return -1;
+}
+
+static pid_t startSeed(const std::string& torrentPath, const std::string& payload, int& port) {
+    int fds[2];
+    if (pipe(fds) != 0) return -1;
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        libtorrent::session seed(libtorrent::session_params(loopbackSettings(libtorrent::high_performance_seed())));
+        libtorrent::add_torrent_params params;
+        params.ti = std::make_shared<libtorrent::torrent_info>(torrentPath);
+        params.save_path = std::filesystem::path(payload).parent_path().string();
+        params.flags |= libtorrent::torrent_flags::seed_mode;
+        seed.add_torrent(std::move(params));
+        int listenPort = waitForListenPort(seed);
+        write(fds[1], &listenPort, sizeof(listenPort));
+        close(fds[1]);
+        while (true) pause();
+    }
+    close(fds[1]);
+    port = -1;
+    if (pid < 0 || read(fds[0], &port, sizeof(port)) != sizeof(port)) port = -1;
+    close(fds[0]);
+    return pid;
+}
+
+static BenchResult runDownload(const std::string& torrentPath, const std::string& outputDir, const std::vector<int>& ports,
+                               const TorrentProfile& profile) {
+    std::filesystem::remove_all(outputDir);
+    std::filesystem::create_directories(outputDir);
+    double cpuBefore = cpuSeconds();
+    uint64_t writtenBefore = diskWriteBytes();
+    auto started = std::chrono::steady_clock::now();
+    bool finished = false;
+    double seconds = 0;
+    {
+        libtorrent::session_params sessionParams(loopbackSettings(profile.settings));
+        sessionParams.disk_io_constructor = profile.mmapDisk ? libtorrent::mmap_disk_io_constructor : libtorrent::posix_disk_io_constructor;
+        libtorrent::session session(std::move(sessionParams));
+
+        libtorrent::add_torrent_params params;
+        params.ti = std::make_shared<libtorrent::torrent_info>(torrentPath);
+        params.save_path = outputDir;
+        libtorrent::torrent_handle handle = session.add_torrent(std::move(params));
+        for (int port : ports) {
+            handle.connect_peer(libtorrent::tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), static_cast<unsigned short>(port)));
+        }
+
+        auto deadline = started + std::chrono::minutes(10);
+        while (!finished && std::chrono::steady_clock::now() < deadline) {
+            session.wait_for_alert(std::chrono::milliseconds(500));
+            std::vector<libtorrent::alert*> alerts;
+            session.pop_alerts(&alerts);
+            for (auto* alert : alerts) {
+                if (libtorrent::alert_cast<libtorrent::torrent_finished_alert>(alert)) finished = true;
+                if (auto* error = libtorrent::alert_cast<libtorrent::torrent_error_alert>(alert)) {
+                    fprintf(stderr, "    torrent error: %s\n", error->message().c_str());
+                    deadline = std::chrono::steady_clock::now();
+                }
+            }
+        }
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    }
+    sync();
+    return {finished, seconds, cpuSeconds() - cpuBefore, diskWriteBytes() - writtenBefore};
+}
+
+static std::vector<std::string> split(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+int main(int argc, char* argv[]) {
+    std::string dir = "/tmp/smart-terminal-torrent-bench";
+    std::string profileName = "desktop";
+    std::vector<std::string> layouts = {"single", "many"};
+    std::vector<int> pieceSizes = {256 * 1024, 1024 * 1024, 4096 * 1024};
+    uint64_t size = 512ULL << 20;
+    int seeds = 2;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--size" && i + 1 < argc) size = strtoull(argv[++i], nullptr, 10) << 20;
+        else if (arg == "--seeds" && i + 1 < argc) seeds = atoi(argv[++i]);
+        else if (arg == "--profile" && i + 1 < argc) profileName = argv[++i];
+        else if (arg == "--dir" && i + 1 < argc) dir = argv[++i];
+        else if (arg == "--layouts" && i + 1 < argc) layouts = split(argv[++i]);
+        else if (arg == "--pieces" && i + 1 < argc) {
+            pieceSizes.clear();
+            for (const auto& kib : split(argv[++i])) pieceSizes.push_back(atoi(kib.c_str()) * 1024);
+        } else {
+            fprintf(stderr, "usage: %s [--size MiB] [--seeds N] [--profile name] [--layouts single,many,small] "
+                            "[--pieces KiB,KiB] [--dir path]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    TorrentProfiles profiles;
+    profiles.load(TORRENT_CONFIG);
+    TorrentProfile profile = profiles.build(profileName);
+    printf("profile %s, %d loopback seeds, %.1f MiB payload\n", profile.name.c_str(), seeds, size / 1048576.0);
+    for (const auto& layout : layouts) {
+        std::string payload = makePayload(dir, layout, size);
+        for (int pieceSize : pieceSizes) {
+            std::string torrentPath = makeTorrent(payload, pieceSize);
+            uint64_t total = static_cast<uint64_t>(libtorrent::torrent_info(torrentPath).total_size());
+            std::vector<pid_t> children;
+            std::vector<int> ports;
+            for (int i = 0; i < seeds; ++i) {
+                int port;
+                pid_t child = startSeed(torrentPath, payload, port);
+                if (child > 0) children.push_back(child);
+                if (port > 0) ports.push_back(port);
+            }
+            BenchResult result = ports.empty() ? BenchResult{false, 0, 0, 0}
+                                               : runDownload(torrentPath, dir + "/out", ports, profile);
+            for (pid_t child : children) {
+                kill(child, SIGKILL);
+                waitpid(child, nullptr, 0);
+            }
+            printf("%-7s %5d KiB pieces %8.1f MB/s %8.3f CPU s/GB %6.2fx disk writes %8.2fs%s\n", layout.c_str(),
+                   pieceSize / 1024, result.seconds > 0 ? total / 1e6 / result.seconds : 0.0,
+                   result.cpuSeconds / (total / 1e9), static_cast<double>(result.diskWritten) / total, result.seconds,
+                   result.ok ? "" : "  (did not finish)");
+        }
+    }
+    std::filesystem::remove_all(dir + "/out");
+    return 0;
+}
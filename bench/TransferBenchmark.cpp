@@ -0,0 +1,148 @@
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../src/FileSharingServer.hpp"
+#include "../src/FileSharingClient.hpp"
+
+struct BenchResult {
+    double seconds;
+    double cpuSeconds;
+};
+
+static double cpuSeconds() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static void makeInput(const std::string& path, uint64_t size, bool text) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    std::mt19937_64 random(size);
+    std::vector<char> block(1 << 20);
+    const char* words[] = {"alpha", "beta", "gamma", "delta", "omega"};
+    for (uint64_t written = 0; written < size; written += block.size()) {
+        if (text) {
+            std::string lines;
+            while (lines.size() < block.size()) {
+                lines += std::to_string(random() % 100000) + "," + words[random() % 5] + "," + std::to_string(random() % 997) + "\n";
+            }
+            std::copy(lines.begin(), lines.begin() + block.size(), block.begin());
+        } else {
+            for (size_t i = 0; i < block.size(); i += 8) *reinterpret_cast<uint64_t*>(&block[i]) = random();
+        }
+        out.write(block.data(), static_cast<std::streamsize>(std::min<uint64_t>(block.size(), size - written)));
+    }
+}
+
+static void printStats(const char* side, const TransferStats& stats) {
+    uint64_t socketCalls = stats.socketCalls;
+    uint64_t diskCalls = stats.diskCalls;
+    printf("    %-8s socket %8lu calls avg %8.1f KiB %6.3fs | disk %8lu calls avg %8.1f KiB %6.3fs\n", side,
+           static_cast<unsigned long>(socketCalls), socketCalls ? stats.socketBytes / 1024.0 / socketCalls : 0.0,
+           stats.socketNanos / 1e9, static_cast<unsigned long>(diskCalls),
+           diskCalls ? stats.diskBytes / 1024.0 / diskCalls : 0.0, stats.diskNanos / 1e9);
+}
+
+static void report(const char* mode, uint64_t size, const BenchResult& result) {
+    double gigabytes = size / 1e9;
+    printf("%-8s %10.1f MiB %8.3f GB/s %8.3f CPU s/GB %8.3fs\n", mode, size / 1048576.0, gigabytes / result.seconds,
+           result.cpuSeconds / gigabytes, result.seconds);
+}
+
+static void runCurrent(const std::string& input, uint64_t size, const std::string& outputDir, int streams, bool compress,
+                       bool verify) {
+    Server server(0);
+    int port = server.getPort();
+    double cpuBefore = cpuSeconds();
+    auto started = std::chrono::steady_clock::now();
+    std::thread receiver([&]() {
+        server.acceptConnection();
+        if (!server.receiveFile(outputDir + "/")) fprintf(stderr, "receive failed: %s\n", server.getLastError().c_str());
+    });
+    FileTransferClient client("127.0.0.1", port, input, streams);
+    client.setCompression(compress);
+    client.setVerification(verify);
+    client.connectToServer();
+    if (!client.sendFile()) fprintf(stderr, "send failed: %s\n", client.getLastError().c_str());
+    receiver.join();
+    BenchResult result{std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count(),
+                       cpuSeconds() - cpuBefore};
+    report("current", size, result);
+    printStats("sender", client.getStats());
+    printStats("receiver", server.getStats());
+}
+
+static BenchResult runLegacy(const std::string& input, const std::string& output) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    bind(listener, (struct sockaddr *)&address, sizeof(address));
+    listen(listener, 1);
+    getsockname(listener, (struct sockaddr *)&address, &length);
+
+    double cpuBefore = cpuSeconds();
+    auto started = std::chrono::steady_clock::now();
+    std::thread receiver([&]() {
+        int sock = accept(listener, nullptr, nullptr);
+        std::ofstream outfile(output, std::ios::binary);
+        char buffer[1024];
+        ssize_t got;
+        while ((got = read(sock, buffer, sizeof(buffer))) > 0) outfile.write(buffer, got);
+        close(sock);
+    });
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    connect(sock, (struct sockaddr *)&address, sizeof(address));
+    std::ifstream infile(input, std::ios::binary);
+    char buffer[1024];
+    while (infile.read(buffer, sizeof(buffer))) send(sock, buffer, infile.gcount(), 0);
+    send(sock, buffer, infile.gcount(), 0);
+    close(sock);
+    receiver.join();
+    close(listener);
+    return {std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count(), cpuSeconds() - cpuBefore};
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<uint64_t> sizes;
+    std::string dir = "/tmp/smart-terminal-bench";
+    int streams = TransferProtocol::kDefaultStreams;
+    bool legacy = false, text = false, compress = true, verify = true;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--legacy") legacy = true;
+        else if (arg == "--text") text = true;
+        else if (arg == "--no-compress") compress = false;
+        else if (arg == "--no-verify") verify = false;
+        else if (arg == "--streams" && i + 1 < argc) streams = atoi(argv[++i]);
+        else if (arg == "--dir" && i + 1 < argc) dir = argv[++i];
+        else sizes.push_back(strtoull(arg.c_str(), nullptr, 10) << 20);
+    }
+    if (sizes.empty()) sizes = {1ULL << 20, 16ULL << 20, 128ULL << 20, 512ULL << 20};
+
+    std::filesystem::create_directories(dir + "/out");
+    for (uint64_t size : sizes) {
+        std::string input = dir + "/input.bin";
+        std::string output = dir + "/out/input.bin";
+        makeInput(input, size, text);
+        if (legacy) {
+            report("legacy", size, runLegacy(input, output));
+            std::filesystem::remove(output);
+        }
+        runCurrent(input, size, dir + "/out", streams, compress, verify);
+        if (std::filesystem::file_size(output) != size) printf("    size mismatch on receiver\n");
+        std::filesystem::remove(output);
+    }
+    std::filesystem::remove_all(dir);
+    return 0;
+}
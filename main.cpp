@@ -1,3 +1,4 @@
+#include <utility>
 #include <boost/asio.hpp>
 #include <ncurses.h>
 #include <iostream>
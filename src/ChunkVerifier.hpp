@@ -0,0 +1,191 @@
+#ifndef CHUNK_VERIFIER_HPP
+#define CHUNK_VERIFIER_HPP
+
+#include <openssl/evp.h>
+#include <unistd.h>
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "FileSharingProtocol.hpp"
+
+using ChunkDigest = std::array<unsigned char, 32>;
+
+class ChunkVerifier {
+public:
+    static constexpr int kMaxRounds = 3;
+    static constexpr size_t kReadSize = 1 << 20;
+
+    ChunkVerifier(int fd, const TransferHeader& header)
+        : fd(fd), header(header), digests(header.chunkCount()), hashed(header.chunkCount(), false) {}
+
+    ~ChunkVerifier() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        queued.notify_all();
+        if (worker.joinable()) worker.join();
+    }
+
+    void start() {
+        worker = std::thread(&ChunkVerifier::hashLoop, this);
+    }
+
+    void add(uint32_t index) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            pending.push_back(index);
+        }
+        queued.notify_one();
+    }
+
+    void addAll() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            for (uint32_t i = 0; i < header.chunkCount(); ++i) pending.push_back(i);
+        }
+        queued.notify_one();
+    }
+
+    void addPresent(const ChunkBitmap& bitmap) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            for (uint32_t i = 0; i < bitmap.size(); ++i) {
+                if (bitmap.test(i)) pending.push_back(i);
+            }
+        }
+        queued.notify_one();
+    }
+
+    bool finish() {
+        std::unique_lock<std::mutex> lock(mtx);
+        drained.wait(lock, [this]() { return pending.empty() && !busy; });
+        return !readFailed;
+    }
+
+    const std::vector<ChunkDigest>& getDigests() const { return digests; }
+
+    std::vector<uint32_t> mismatches(const std::vector<ChunkDigest>& expected, const ChunkBitmap& bitmap) const {
+        std::vector<uint32_t> bad;
+        for (uint32_t i = 0; i < bitmap.size(); ++i) {
+            if (bitmap.test(i) && (!hashed[i] || digests[i] != expected[i])) bad.push_back(i);
+        }
+        return bad;
+    }
+
+    static ChunkDigest rootOf(const std::vector<ChunkDigest>& leaves, uint64_t size) {
+        std::vector<ChunkDigest> level = leaves;
+        while (level.size() > 1) {
+            std::vector<ChunkDigest> next;
+            for (size_t i = 0; i < level.size(); i += 2) {
+                if (i + 1 == level.size()) {
+                    next.push_back(level[i]);
+                    continue;
+                }
+                unsigned char pair[64];
+                std::memcpy(pair, level[i].data(), 32);
+                std::memcpy(pair + 32, level[i + 1].data(), 32);
+                next.push_back(digestOf(pair, sizeof(pair)));
+            }
+            level.swap(next);
+        }
+        unsigned char tail[40] = {};
+        uint64_t encoded = htobe64(size);
+        std::memcpy(tail, &encoded, 8);
+        if (!level.empty()) std::memcpy(tail + 8, level[0].data(), 32);
+        return digestOf(tail, sizeof(tail));
+    }
+
+    static void writeDigests(WireBuffer& buffer, const std::vector<ChunkDigest>& leaves, uint64_t size) {
+        buffer.putU32(static_cast<uint32_t>(leaves.size()));
+        for (const auto& leaf : leaves) buffer.putBytes(leaf.data(), leaf.size());
+        ChunkDigest root = rootOf(leaves, size);
+        buffer.putBytes(root.data(), root.size());
+    }
+
+    static bool readDigests(WireReader& reader, uint32_t expectedCount, uint64_t size, std::vector<ChunkDigest>& leaves) {
+        uint32_t count;
+        if (!reader.getU32(count) || count != expectedCount) return false;
+        leaves.resize(count);
+        ChunkDigest root;
+        for (auto& leaf : leaves) {
+            if (!reader.getBytes(leaf.data(), leaf.size())) return false;
+        }
+        return reader.getBytes(root.data(), root.size()) && rootOf(leaves, size) == root;
+    }
+
+    static bool parseDigests(const std::string& data, uint64_t size, std::vector<ChunkDigest>& leaves) {
+        size_t count = (data.size() - 32) / 32;
+        leaves.resize(count);
+        for (size_t i = 0; i < count; ++i) std::memcpy(leaves[i].data(), data.data() + i * 32, 32);
+        ChunkDigest root;
+        std::memcpy(root.data(), data.data() + count * 32, 32);
+        return rootOf(leaves, size) == root;
+    }
+
+private:
+    int fd;
+    const TransferHeader& header;
+    std::vector<ChunkDigest> digests;
+    std::vector<bool> hashed;
+    std::thread worker;
+    std::mutex mtx;
+    std::condition_variable queued;
+    std::condition_variable drained;
+    std::deque<uint32_t> pending;
+    bool busy = false;
+    bool stopping = false;
+    bool readFailed = false;
+
+    static ChunkDigest digestOf(const unsigned char* data, size_t length) {
+        ChunkDigest digest;
+        unsigned int digestLength = 0;
+        EVP_Digest(data, length, digest.data(), &digestLength, EVP_sha256(), nullptr);
+        return digest;
+    }
+
+    void hashLoop() {
+        std::vector<char> buffer(kReadSize);
+        EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+        while (true) {
+            uint32_t index;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                busy = false;
+                if (pending.empty()) drained.notify_all();
+                queued.wait(lock, [this]() { return stopping || !pending.empty(); });
+                if (stopping) break;
+                index = pending.front();
+                pending.pop_front();
+                busy = true;
+            }
+            uint32_t length = header.chunkLength(index);
+            off_t offset = static_cast<off_t>(index) * header.chunkSize;
+            EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr);
+            uint32_t done = 0;
+            while (done < length) {
+                ssize_t got = pread(fd, buffer.data(), std::min<size_t>(buffer.size(), length - done), offset + done);
+                if (got < 0 && errno == EINTR) continue;
+                if (got <= 0) break;
+                EVP_DigestUpdate(ctx, buffer.data(), static_cast<size_t>(got));
+                done += static_cast<uint32_t>(got);
+            }
+            ChunkDigest digest;
+            unsigned int digestLength = 0;
+            EVP_DigestFinal_ex(ctx, digest.data(), &digestLength);
+            std::lock_guard<std::mutex> lock(mtx);
+            if (done == length) {
+                digests[index] = digest;
+                hashed[index] = true;
+            } else {
+                hashed[index] = false;
+                readFailed = true;
+            }
+        }
+        EVP_MD_CTX_free(ctx);
+    }
+};
+#endif
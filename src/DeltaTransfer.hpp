@@ -0,0 +1,317 @@
+#ifndef DELTA_TRANSFER_HPP
+#define DELTA_TRANSFER_HPP
+
+#include <openssl/evp.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include "FileSharingProtocol.hpp"
+
+using StrongSum = std::array<unsigned char, 16>;
+
+struct BlockSignature {
+    uint32_t weak;
+    StrongSum strong;
+};
+
+struct DeltaOp {
+    enum Type : uint8_t { End = 0, Copy = 1, Literal = 2 };
+    Type type;
+    uint64_t offset;
+    uint64_t length;
+    uint32_t block;
+};
+
+class RollingChecksum {
+public:
+    void reset(const unsigned char* data, size_t length) {
+        a = b = 0;
+        window = static_cast<uint32_t>(length);
+        for (size_t i = 0; i < length; ++i) {
+            a += data[i] + kCharOffset;
+            b += (window - i) * (data[i] + kCharOffset);
+        }
+    }
+
+    void roll(unsigned char out, unsigned char in) {
+        a += static_cast<uint32_t>(in) - out;
+        b += a - window * (out + kCharOffset);
+    }
+
+    uint32_t digest() const {
+        return (a & 0xFFFF) | (b << 16);
+    }
+
+    static uint32_t of(const unsigned char* data, size_t length) {
+        RollingChecksum sum;
+        sum.reset(data, length);
+        return sum.digest();
+    }
+
+private:
+    static constexpr uint32_t kCharOffset = 31;
+    uint32_t a = 0, b = 0, window = 0;
+};
+
+class DeltaTransfer {
+public:
+    static constexpr uint32_t kMinBlockSize = 2048;
+    static constexpr uint32_t kMaxBlockSize = 131072;
+
+    static uint32_t chooseBlockSize(uint64_t basisSize) {
+        uint64_t root = static_cast<uint64_t>(std::sqrt(static_cast<double>(basisSize)));
+        root = (root + 1023) & ~1023ULL;
+        return static_cast<uint32_t>(std::clamp<uint64_t>(root, kMinBlockSize, kMaxBlockSize));
+    }
+
+    static uint64_t maxSignatures(uint64_t size, uint32_t blockSize) {
+        return size / blockSize + 1;
+    }
+
+    static StrongSum strongSum(const unsigned char* data, size_t length) {
+        unsigned char digest[EVP_MAX_MD_SIZE];
+        unsigned int digestLength = 0;
+        EVP_Digest(data, length, digest, &digestLength, EVP_sha256(), nullptr);
+        StrongSum sum;
+        std::memcpy(sum.data(), digest, sum.size());
+        return sum;
+    }
+
+    static std::vector<BlockSignature> computeSignatures(int fd, uint64_t size, uint32_t blockSize) {
+        uint32_t blockCount = static_cast<uint32_t>(size / blockSize);
+        std::vector<BlockSignature> signatures(blockCount);
+        unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+        uint32_t perWorker = (blockCount + workers - 1) / std::max(1u, workers);
+        std::vector<std::thread> pool;
+        for (unsigned w = 0; w < workers && w * perWorker < blockCount; ++w) {
+            uint32_t first = w * perWorker;
+            uint32_t last = std::min(blockCount, first + perWorker);
+            pool.emplace_back([&, first, last]() {
+                uint32_t batch = std::max<uint32_t>(1, (1u << 20) / blockSize);
+                std::vector<unsigned char> buffer(static_cast<size_t>(batch) * blockSize);
+                for (uint32_t block = first; block < last; block += batch) {
+                    uint32_t count = std::min(batch, last - block);
+                    size_t length = static_cast<size_t>(count) * blockSize;
+                    ssize_t got = pread(fd, buffer.data(), length, static_cast<off_t>(block) * blockSize);
+                    if (got != static_cast<ssize_t>(length)) return;
+                    for (uint32_t i = 0; i < count; ++i) {
+                        const unsigned char* data = buffer.data() + static_cast<size_t>(i) * blockSize;
+                        signatures[block + i] = {RollingChecksum::of(data, blockSize), strongSum(data, blockSize)};
+                    }
+                }
+            });
+        }
+        for (auto& thread : pool) thread.join();
+        return signatures;
+    }
+
+    static bool sendSignatures(int sock, uint32_t blockSize, const std::vector<BlockSignature>& signatures) {
+        WireBuffer buffer;
+        buffer.putU32(blockSize);
+        buffer.putU32(static_cast<uint32_t>(signatures.size()));
+        for (const auto& signature : signatures) {
+            buffer.putU32(signature.weak);
+            buffer.putBytes(signature.strong.data(), signature.strong.size());
+            if (buffer.size() >= (1 << 20) && !buffer.flush(sock)) return false;
+        }
+        return buffer.flush(sock);
+    }
+
+    static bool readSignatures(WireReader& reader, uint64_t size, uint32_t& blockSize, std::vector<BlockSignature>& signatures) {
+        uint32_t count;
+        if (!reader.getU32(blockSize) || !reader.getU32(count) || blockSize == 0 || blockSize > kMaxBlockSize ||
+            count > maxSignatures(size, blockSize)) {
+            return false;
+        }
+        signatures.resize(count);
+        for (auto& signature : signatures) {
+            if (!reader.getU32(signature.weak) || !reader.getBytes(signature.strong.data(), signature.strong.size())) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static std::vector<DeltaOp> computeDelta(int fd, uint64_t size, uint32_t blockSize, const std::vector<BlockSignature>& signatures) {
+        std::vector<DeltaOp> ops;
+        if (size == 0) return ops;
+        if (signatures.empty() || size < blockSize) {
+            ops.push_back({DeltaOp::Literal, 0, size, 0});
+            return ops;
+        }
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            ops.push_back({DeltaOp::Literal, 0, size, 0});
+            return ops;
+        }
+        madvise(mapped, size, MADV_SEQUENTIAL);
+        const unsigned char* data = static_cast<const unsigned char*>(mapped);
+
+        std::unordered_map<uint32_t, std::vector<uint32_t>> table;
+        table.reserve(signatures.size());
+        for (uint32_t i = 0; i < signatures.size(); ++i) {
+            table[signatures[i].weak].push_back(i);
+        }
+
+        unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+        uint64_t regionSize = std::max<uint64_t>((size + workers - 1) / workers, 4ULL * blockSize);
+        std::vector<std::vector<DeltaOp>> regions((size + regionSize - 1) / regionSize);
+        std::vector<std::thread> pool;
+        for (size_t r = 0; r < regions.size(); ++r) {
+            pool.emplace_back([&, r]() {
+                uint64_t start = r * regionSize;
+                uint64_t end = std::min(size, start + regionSize);
+                matchRegion(data, size, start, end, blockSize, signatures, table, regions[r]);
+            });
+        }
+        for (auto& thread : pool) thread.join();
+        munmap(mapped, size);
+
+        uint64_t cursor = 0;
+        for (const auto& region : regions) {
+            for (DeltaOp op : region) {
+                uint64_t opEnd = op.offset + op.length;
+                if (opEnd <= cursor) continue;
+                if (op.offset < cursor) {
+                    op = {DeltaOp::Literal, cursor, opEnd - cursor, 0};
+                }
+                if (op.type == DeltaOp::Literal && !ops.empty() && ops.back().type == DeltaOp::Literal &&
+                    ops.back().offset + ops.back().length == op.offset) {
+                    ops.back().length += op.length;
+                } else {
+                    ops.push_back(op);
+                }
+                cursor = opEnd;
+            }
+        }
+        return ops;
+    }
+
+    static bool sendDelta(int sock, int fd, const std::vector<DeltaOp>& ops) {
+        WireBuffer buffer;
+        for (size_t i = 0; i < ops.size(); ++i) {
+            const DeltaOp& op = ops[i];
+            if (op.type == DeltaOp::Copy) {
+                uint32_t run = 1;
+                while (i + run < ops.size() && ops[i + run].type == DeltaOp::Copy &&
+                       ops[i + run].block == op.block + run) {
+                    ++run;
+                }
+                buffer.putU8(DeltaOp::Copy);
+                buffer.putU32(op.block);
+                buffer.putU32(run);
+                TransferStats::reportProgress(op.length * run);
+                i += run - 1;
+                continue;
+            }
+            uint64_t offset = op.offset;
+            uint64_t remaining = op.length;
+            while (remaining > 0) {
+                uint32_t length = static_cast<uint32_t>(std::min<uint64_t>(remaining, 1 << 30));
+                buffer.putU8(DeltaOp::Literal);
+                buffer.putU32(length);
+                if (!buffer.flush(sock) || !TransferIO::sendFileRange(sock, fd, static_cast<off_t>(offset), length)) {
+                    return false;
+                }
+                offset += length;
+                remaining -= length;
+                TransferStats::reportProgress(length);
+            }
+        }
+        buffer.putU8(DeltaOp::End);
+        return buffer.flush(sock);
+    }
+
+    static bool applyDelta(WireReader& reader, int sock, int basisFd, uint32_t blockSize, uint32_t blockCount, int outFd, uint64_t& written) {
+        written = 0;
+        uint8_t type;
+        while (reader.getU8(type)) {
+            if (type == DeltaOp::End) return true;
+            if (type == DeltaOp::Copy) {
+                uint32_t block, run;
+                if (!reader.getU32(block) || !reader.getU32(run)) return false;
+                if (static_cast<uint64_t>(block) + run > blockCount) return false;
+                off_t in = static_cast<off_t>(block) * blockSize;
+                off_t out = static_cast<off_t>(written);
+                uint64_t length = static_cast<uint64_t>(run) * blockSize;
+                if (!copyRange(basisFd, in, outFd, out, length)) return false;
+                written += length;
+                TransferStats::reportProgress(length);
+            } else if (type == DeltaOp::Literal) {
+                uint32_t length;
+                if (!reader.getU32(length)) return false;
+                if (TransferIO::receiveToFile(sock, outFd, static_cast<off_t>(written), length) != length) return false;
+                written += length;
+                TransferStats::reportProgress(length);
+            } else {
+                return false;
+            }
+        }
+        return false;
+    }
+
+private:
+    static void matchRegion(const unsigned char* data, uint64_t size, uint64_t start, uint64_t end, uint32_t blockSize,
+                            const std::vector<BlockSignature>& signatures,
+                            const std::unordered_map<uint32_t, std::vector<uint32_t>>& table,
+                            std::vector<DeltaOp>& ops) {
+        uint64_t pos = start;
+        uint64_t literalStart = start;
+        RollingChecksum sum;
+        bool valid = false;
+        while (pos < end && pos + blockSize <= size) {
+            if (!valid) {
+                sum.reset(data + pos, blockSize);
+                valid = true;
+            }
+            auto candidates = table.find(sum.digest());
+            if (candidates != table.end()) {
+                StrongSum strong = strongSum(data + pos, blockSize);
+                auto match = std::find_if(candidates->second.begin(), candidates->second.end(), [&](uint32_t block) {
+                    return signatures[block].strong == strong;
+                });
+                if (match != candidates->second.end()) {
+                    if (pos > literalStart) ops.push_back({DeltaOp::Literal, literalStart, pos - literalStart, 0});
+                    ops.push_back({DeltaOp::Copy, pos, blockSize, *match});
+                    pos += blockSize;
+                    literalStart = pos;
+                    valid = false;
+                    continue;
+                }
+            }
+            if (pos + blockSize < size) sum.roll(data[pos], data[pos + blockSize]);
+            ++pos;
+        }
+        uint64_t literalEnd = std::max(pos, end);
+        if (literalEnd > literalStart) ops.push_back({DeltaOp::Literal, literalStart, literalEnd - literalStart, 0});
+    }
+
+    static bool copyRange(int inFd, off_t in, int outFd, off_t out, uint64_t length) {
+        while (length > 0) {
+            ssize_t copied = copy_file_range(inFd, &in, outFd, &out, static_cast<size_t>(std::min<uint64_t>(length, 1ULL << 30)), 0);
+            if (copied < 0 && errno == EINTR) continue;
+            if (copied <= 0) break;
+            length -= static_cast<uint64_t>(copied);
+        }
+        std::vector<char> buffer(1 << 20);
+        while (length > 0) {
+            size_t step = static_cast<size_t>(std::min<uint64_t>(length, buffer.size()));
+            ssize_t got = pread(inFd, buffer.data(), step, in);
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0 || !TransferIO::pwriteAll(outFd, buffer.data(), static_cast<size_t>(got), out)) return false;
+            in += got;
+            out += got;
+            length -= static_cast<uint64_t>(got);
+        }
+        return true;
+    }
+};
+#endif
@@ -0,0 +1,320 @@
+#ifndef DIRECTORY_LOADER_HPP
+#define DIRECTORY_LOADER_HPP
+
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct DirectoryEntry {
+    uint64_t sortKey;
+    uint64_t inode;
+    uint32_t nameOffset;
+    uint16_t nameLength;
+    bool isDirectory;
+};
+
+struct NameArena {
+    std::vector<char> bytes;
+
+    uint32_t add(const char* name, size_t length) {
+        uint32_t offset = static_cast<uint32_t>(bytes.size());
+        bytes.insert(bytes.end(), name, name + length);
+        bytes.push_back('\0');
+        return offset;
+    }
+
+    const char* at(uint32_t offset) const { return bytes.data() + offset; }
+};
+
+struct DirectoryListing {
+    std::string path;
+    dev_t device = 0;
+    ino_t inode = 0;
+    struct timespec mtime{};
+    std::vector<DirectoryEntry> entries;
+    NameArena names;
+    bool complete = false;
+    std::string error;
+
+    const char* name(const DirectoryEntry& entry) const { return names.at(entry.nameOffset); }
+
+    size_t memory() const {
+        return sizeof(*this) + entries.capacity() * sizeof(DirectoryEntry) + names.bytes.capacity() + path.capacity();
+    }
+};
+
+struct EntryOrder {
+    const NameArena* names;
+
+    bool operator()(const DirectoryEntry& a, const DirectoryEntry& b) const {
+        if (a.sortKey != b.sortKey) return a.sortKey < b.sortKey;
+        return strcmp(names->at(a.nameOffset), names->at(b.nameOffset)) < 0;
+    }
+};
+
+class DirectoryLoader {
+public:
+    static constexpr size_t kReadBufferSize = 256 * 1024;
+    static constexpr size_t kPublishEntries = 16384;
+    static constexpr size_t kCacheBytes = 64 * 1024 * 1024;
+
+    DirectoryLoader() : updateFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+        worker = std::thread(&DirectoryLoader::run, this);
+    }
+
+    ~DirectoryLoader() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+            ++generation;
+        }
+        wake.notify_one();
+        worker.join();
+        close(updateFd);
+    }
+
+    std::shared_ptr<DirectoryListing> open(const std::string& path, bool reload) {
+        struct stat info;
+        bool found = stat(path.c_str(), &info) == 0;
+        std::lock_guard<std::mutex> lock(mtx);
+        ++generation;
+        pending.clear();
+        if (found && !reload) {
+            auto cached = cache.find({info.st_dev, info.st_ino});
+            if (cached != cache.end() && sameTime(cached->second.listing->mtime, info.st_mtim)) {
+                recent.splice(recent.begin(), recent, cached->second.position);
+                requested = false;
+                current = cached->second.listing;
+                return current;
+            }
+        }
+        current = std::make_shared<DirectoryListing>();
+        current->path = path;
+        if (found) {
+            current->device = info.st_dev;
+            current->inode = info.st_ino;
+            current->mtime = info.st_mtim;
+        }
+        current->entries.push_back({sortKey("..", 2, true), 0, current->names.add("..", 2), 2, true});
+        requestedPath = path;
+        requestedGeneration = generation;
+        requested = true;
+        wake.notify_one();
+        return current;
+    }
+
+    bool poll() {
+        uint64_t count;
+        while (read(updateFd, &count, sizeof(count)) > 0) {}
+        std::vector<Batch> batches;
+        std::shared_ptr<DirectoryListing> listing;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            for (auto& batch : pending) {
+                if (batch.generation == generation) batches.push_back(std::move(batch));
+            }
+            pending.clear();
+            listing = current;
+        }
+        bool changed = false;
+        for (auto& batch : batches) {
+            std::vector<DirectoryEntry>& entries = listing->entries;
+            size_t middle = entries.size();
+            uint32_t base = static_cast<uint32_t>(listing->names.bytes.size());
+            listing->names.bytes.insert(listing->names.bytes.end(), batch.names.bytes.begin(), batch.names.bytes.end());
+            for (auto& entry : batch.entries) entry.nameOffset += base;
+            EntryOrder order{&listing->names};
+            std::sort(batch.entries.begin(), batch.entries.end(), order);
+            entries.insert(entries.end(), batch.entries.begin(), batch.entries.end());
+            std::inplace_merge(entries.begin(), entries.begin() + middle, entries.end(), order);
+            if (!batch.error.empty()) listing->error = batch.error;
+            if (batch.last) {
+                listing->complete = true;
+                entries.shrink_to_fit();
+                listing->names.bytes.shrink_to_fit();
+                if (listing->error.empty()) remember(listing);
+            }
+            changed = true;
+        }
+        return changed;
+    }
+
+    bool isLoading() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return current && !current->complete;
+    }
+
+    int getUpdateFd() const { return updateFd; }
+
+    size_t cachedBytes() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return cacheBytes;
+    }
+
+    static uint64_t sortKey(const char* name, size_t length, bool isDirectory) {
+        uint64_t key = isDirectory ? 0 : 1;
+        for (size_t i = 0; i < 7; ++i) {
+            key = (key << 8) | (i < length ? static_cast<unsigned char>(name[i]) : 0);
+        }
+        return key;
+    }
+
+
+private:
+    struct Batch {
+        uint64_t generation;
+        std::vector<DirectoryEntry> entries;
+        NameArena names;
+        bool last;
+        std::string error;
+    };
+
+    struct CacheSlot {
+        std::shared_ptr<DirectoryListing> listing;
+        std::list<std::pair<dev_t, ino_t>>::iterator position;
+        size_t bytes;
+    };
+
+    struct LinuxDirent64 {
+        ino64_t d_ino;
+        off64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+    };
+
+    std::mutex mtx;
+    std::condition_variable wake;
+    std::thread worker;
+    int updateFd;
+    bool stopping = false;
+    bool requested = false;
+    uint64_t generation = 0;
+    uint64_t requestedGeneration = 0;
+    std::string requestedPath;
+    std::shared_ptr<DirectoryListing> current;
+    std::vector<Batch> pending;
+    std::map<std::pair<dev_t, ino_t>, CacheSlot> cache;
+    std::list<std::pair<dev_t, ino_t>> recent;
+    size_t cacheBytes = 0;
+
+    void remember(const std::shared_ptr<DirectoryListing>& listing) {
+        std::lock_guard<std::mutex> lock(mtx);
+        std::pair<dev_t, ino_t> key{listing->device, listing->inode};
+        auto existing = cache.find(key);
+        if (existing != cache.end()) {
+            cacheBytes -= existing->second.bytes;
+            recent.erase(existing->second.position);
+            cache.erase(existing);
+        }
+        recent.push_front(key);
+        size_t bytes = listing->memory();
+        cache[key] = {listing, recent.begin(), bytes};
+        cacheBytes += bytes;
+        while (cacheBytes > kCacheBytes && recent.size() > 1) {
+            auto oldest = cache.find(recent.back());
+            cacheBytes -= oldest->second.bytes;
+            cache.erase(oldest);
+            recent.pop_back();
+        }
+    }
+
+    static bool sameTime(const struct timespec& a, const struct timespec& b) {
+        return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+    }
+
+    void run() {
+        while (true) {
+            std::string path;
+            uint64_t job;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                wake.wait(lock, [this]() { return stopping || requested; });
+                if (stopping) return;
+                requested = false;
+                path = requestedPath;
+                job = requestedGeneration;
+            }
+            load(path, job);
+        }
+    }
+
+    bool cancelled(uint64_t job) {
+        std::lock_guard<std::mutex> lock(mtx);
+        return job != generation;
+    }
+
+    void publish(uint64_t job, std::vector<DirectoryEntry>& entries, NameArena& names, bool last, const std::string& error) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (job != generation) return;
+            pending.push_back({job, std::move(entries), std::move(names), last, error});
+        }
+        entries.clear();
+        names.bytes.clear();
+        uint64_t one = 1;
+        write(updateFd, &one, sizeof(one));
+    }
+
+    void load(const std::string& path, uint64_t job) {
+        std::vector<DirectoryEntry> batch;
+        NameArena names;
+        int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+            publish(job, batch, names, true, "Failed to open directory: " + path + " (" + strerror(errno) + ")");
+            return;
+        }
+        std::vector<char> buffer(kReadBufferSize);
+        bool first = true;
+        std::string error;
+        while (true) {
+            long bytes = syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+            if (bytes < 0) {
+                error = "Failed to read directory: " + path + " (" + strerror(errno) + ")";
+                break;
+            }
+            if (bytes == 0) break;
+            for (long position = 0; position < bytes;) {
+                auto* entry = reinterpret_cast<LinuxDirent64*>(buffer.data() + position);
+                position += entry->d_reclen;
+                const char* name = entry->d_name;
+                if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || strcmp(name, ".versions") == 0 ||
+                    strcmp(name, "RESUME_DIR") == 0) {
+                    continue;
+                }
+                bool isDirectory = entry->d_type == DT_DIR;
+                if (entry->d_type == DT_UNKNOWN) {
+                    struct stat info;
+                    isDirectory = fstatat(fd, name, &info, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(info.st_mode);
+                }
+                size_t length = strlen(name);
+                batch.push_back({sortKey(name, length, isDirectory), entry->d_ino, names.add(name, length),
+                                 static_cast<uint16_t>(length), isDirectory});
+            }
+            if (cancelled(job)) {
+                ::close(fd);
+                return;
+            }
+            if (first || batch.size() >= kPublishEntries) {
+                publish(job, batch, names, false, "");
+                first = false;
+            }
+        }
+        ::close(fd);
+        publish(job, batch, names, true, error);
+    }
+};
+#endif
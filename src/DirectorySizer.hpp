@@ -0,0 +1,322 @@
+#ifndef DIRECTORY_SIZER_HPP
+#define DIRECTORY_SIZER_HPP
+
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <ctime>
+#include <unordered_map>
+#include <vector>
+
+class DirectorySizer {
+public:
+    static constexpr unsigned kMinThreads = 4;
+    static constexpr unsigned kMaxThreads = 16;
+    static constexpr unsigned kStatxMask = STATX_TYPE | STATX_MODE | STATX_INO | STATX_NLINK | STATX_BLOCKS | STATX_MTIME;
+    static constexpr int kStatxFlags = AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC;
+    static constexpr size_t kCacheBytes = 64 * 1024 * 1024;
+    static constexpr int64_t kRecordMaxAge = 90 * 24 * 3600;
+
+    DirectorySizer() : DirectorySizer(defaultCachePath()) {}
+
+    explicit DirectorySizer(const std::string& cachePath)
+        : cachePath(cachePath), updateFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+        cacheLoader = std::thread(&DirectorySizer::loadCache, this);
+        unsigned threads = std::clamp(std::thread::hardware_concurrency(), kMinThreads, kMaxThreads);
+        for (unsigned i = 0; i < threads; ++i) workers.emplace_back(&DirectorySizer::work, this);
+    }
+
+    ~DirectorySizer() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+            ++generation;
+            tasks.clear();
+        }
+        wake.notify_all();
+        for (auto& worker : workers) worker.join();
+        cacheLoader.join();
+        saveCache();
+        close(updateFd);
+    }
+
+    void measure(const std::string& path, const std::vector<std::pair<uint64_t, std::string>>& directories) {
+        struct stat info;
+        std::lock_guard<std::mutex> lock(mtx);
+        ++generation;
+        tasks.clear();
+        roots.clear();
+        pendingRoots = 0;
+        sizes.clear();
+        seenLinks.clear();
+        if (stat(path.c_str(), &info) != 0) return;
+        device = info.st_dev;
+        for (const auto& [inode, name] : directories) {
+            roots.push_back({inode, 1, 0, false});
+            tasks.push_back({generation, roots.size() - 1, path + "/" + name, true});
+        }
+        pendingRoots = roots.size();
+        wake.notify_all();
+    }
+
+    bool sizeOf(uint64_t inode, int64_t& bytes) {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = sizes.find(inode);
+        if (it == sizes.end()) return false;
+        bytes = it->second;
+        return true;
+    }
+
+    size_t pendingCount() const {
+        return pendingRoots;
+    }
+
+    int getUpdateFd() const { return updateFd; }
+
+    void drainUpdates() {
+        uint64_t count;
+        while (read(updateFd, &count, sizeof(count)) > 0) {}
+    }
+
+    static std::string defaultCachePath() {
+        const char* home = getenv("HOME");
+        return std::string(home && *home ? home : "/tmp") + "/.smart-terminal-sizes";
+    }
+
+private:
+    using Key = std::pair<uint64_t, uint64_t>;
+
+    struct LinkedFile {
+        uint64_t device;
+        uint64_t inode;
+        uint64_t bytes;
+    };
+
+    struct Record {
+        int64_t mtimeSeconds = 0;
+        uint32_t mtimeNanoseconds = 0;
+        uint64_t bytes = 0;
+        std::vector<LinkedFile> linked;
+        std::vector<std::string> children;
+        bool persistable = true;
+        int64_t usedAt = 0;
+        size_t bytesHeld = 0;
+        std::list<Key>::iterator position;
+    };
+
+    struct Root {
+        uint64_t inode;
+        size_t pending;
+        uint64_t bytes;
+        bool valid;
+    };
+
+    struct Task {
+        uint64_t generation;
+        size_t root;
+        std::string path;
+        bool top;
+    };
+
+    std::string cachePath;
+    int updateFd;
+    std::vector<std::thread> workers;
+    std::thread cacheLoader;
+    std::mutex mtx;
+    std::condition_variable wake;
+    bool stopping = false;
+    uint64_t generation = 0;
+    dev_t device = 0;
+    std::deque<Task> tasks;
+    std::vector<Root> roots;
+    std::atomic<size_t> pendingRoots{0};
+    std::unordered_map<uint64_t, int64_t> sizes;
+    std::set<Key> seenLinks;
+    std::mutex cacheMtx;
+    std::map<Key, Record> records;
+    std::list<Key> recent;
+    size_t recordBytes = 0;
+    bool dirty = false;
+
+    void work() {
+        while (true) {
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (stopping) return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            visit(task);
+        }
+    }
+
+    void visit(const Task& task) {
+        struct statx self;
+        Record record;
+        bool found = statx(AT_FDCWD, task.path.c_str(), kStatxFlags, kStatxMask, &self) == 0 && S_ISDIR(self.stx_mode) &&
+                     makedev(self.stx_dev_major, self.stx_dev_minor) == device;
+        if (found && !lookup(self, record)) found = scan(task.path, self, record);
+        std::lock_guard<std::mutex> lock(mtx);
+        if (task.generation != generation) return;
+        Root& root = roots[task.root];
+        if (found) {
+            if (task.top) root.valid = true;
+            root.bytes += record.bytes;
+            for (const auto& file : record.linked) {
+                if (seenLinks.insert({file.device, file.inode}).second) root.bytes += file.bytes;
+            }
+            for (const auto& child : record.children) {
+                tasks.push_back({generation, task.root, task.path + "/" + child, false});
+            }
+            root.pending += record.children.size();
+            if (!record.children.empty()) wake.notify_all();
+        }
+        if (--root.pending == 0) {
+            --pendingRoots;
+            sizes[root.inode] = root.valid ? static_cast<int64_t>(root.bytes) : -1;
+            uint64_t one = 1;
+            write(updateFd, &one, sizeof(one));
+        }
+    }
+
+    bool lookup(const struct statx& self, Record& record) {
+        std::lock_guard<std::mutex> lock(cacheMtx);
+        auto it = records.find({makedev(self.stx_dev_major, self.stx_dev_minor), self.stx_ino});
+        if (it == records.end() || it->second.mtimeSeconds != self.stx_mtime.tv_sec ||
+            it->second.mtimeNanoseconds != self.stx_mtime.tv_nsec) {
+            return false;
+        }
+        recent.splice(recent.begin(), recent, it->second.position);
+        it->second.usedAt = time(nullptr);
+        dirty = true;
+        record = it->second;
+        return true;
+    }
+
+    bool scan(const std::string& path, const struct statx& self, Record& record) {
+        int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) return false;
+        DIR* dir = fdopendir(fd);
+        if (!dir) {
+            close(fd);
+            return false;
+        }
+        record.mtimeSeconds = self.stx_mtime.tv_sec;
+        record.mtimeNanoseconds = self.stx_mtime.tv_nsec;
+        record.bytes = self.stx_blocks * 512;
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            const char* name = entry->d_name;
+            if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+            struct statx info;
+            if (statx(fd, name, kStatxFlags, kStatxMask, &info) != 0) continue;
+            if (S_ISDIR(info.stx_mode)) {
+                record.children.push_back(name);
+                if (strchr(name, '\n')) record.persistable = false;
+            } else if (info.stx_nlink > 1) {
+                record.linked.push_back({makedev(info.stx_dev_major, info.stx_dev_minor), info.stx_ino, info.stx_blocks * 512});
+            } else {
+                record.bytes += info.stx_blocks * 512;
+            }
+        }
+        closedir(dir);
+        record.usedAt = time(nullptr);
+        std::lock_guard<std::mutex> lock(cacheMtx);
+        remember({makedev(self.stx_dev_major, self.stx_dev_minor), self.stx_ino}, record, true);
+        dirty = true;
+        return true;
+    }
+
+    static size_t footprint(const Record& record) {
+        size_t bytes = sizeof(Record) + sizeof(Key) * 2 + record.linked.capacity() * sizeof(LinkedFile);
+        for (const auto& child : record.children) bytes += sizeof(std::string) + child.capacity();
+        return bytes;
+    }
+
+    bool remember(const Key& key, Record record, bool newest) {
+        auto existing = records.find(key);
+        if (existing != records.end()) {
+            if (!newest) return false;
+            recordBytes -= existing->second.bytesHeld;
+            recent.erase(existing->second.position);
+            records.erase(existing);
+        }
+        record.bytesHeld = footprint(record);
+        record.position = recent.insert(newest ? recent.begin() : recent.end(), key);
+        recordBytes += record.bytesHeld;
+        records.emplace(key, std::move(record));
+        while (recordBytes > kCacheBytes && recent.size() > 1) {
+            auto oldest = records.find(recent.back());
+            recordBytes -= oldest->second.bytesHeld;
+            records.erase(oldest);
+            recent.pop_back();
+        }
+        return true;
+    }
+
+    void loadCache() {
+        std::ifstream in(cachePath);
+        std::string line;
+        int64_t oldest = time(nullptr) - kRecordMaxAge;
+        while (std::getline(in, line)) {
+            std::istringstream header(line);
+            char tag;
+            Key key;
+            Record record;
+            size_t linkedCount, childCount;
+            if (!(header >> tag >> key.first >> key.second >> record.mtimeSeconds >> record.mtimeNanoseconds >> record.bytes >>
+                  record.usedAt >> linkedCount >> childCount) || tag != 'D') {
+                return;
+            }
+            for (size_t i = 0; i < linkedCount && std::getline(in, line); ++i) {
+                LinkedFile file;
+                std::istringstream(line) >> file.device >> file.inode >> file.bytes;
+                record.linked.push_back(file);
+            }
+            for (size_t i = 0; i < childCount && std::getline(in, line); ++i) record.children.push_back(line);
+            if (record.usedAt < oldest) continue;
+            std::lock_guard<std::mutex> lock(cacheMtx);
+            if (recordBytes >= kCacheBytes) return;
+            remember(key, std::move(record), false);
+        }
+    }
+
+    void saveCache() {
+        if (!dirty) return;
+        std::string temporary = cachePath + ".tmp";
+        std::ofstream out(temporary, std::ios::trunc);
+        int64_t oldest = time(nullptr) - kRecordMaxAge;
+        for (const auto& key : recent) {
+            const Record& record = records.at(key);
+            if (!record.persistable || record.usedAt < oldest) continue;
+            out << "D " << key.first << ' ' << key.second << ' ' << record.mtimeSeconds << ' ' << record.mtimeNanoseconds << ' '
+                << record.bytes << ' ' << record.usedAt << ' ' << record.linked.size() << ' ' << record.children.size() << '\n';
+            for (const auto& file : record.linked) out << file.device << ' ' << file.inode << ' ' << file.bytes << '\n';
+            for (const auto& child : record.children) out << child << '\n';
+        }
+        out.close();
+        std::error_code ec;
+        if (out) std::filesystem::rename(temporary, cachePath, ec);
+    }
+};
+#endif
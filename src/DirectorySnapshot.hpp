@@ -0,0 +1,404 @@
+#ifndef DIRECTORY_SNAPSHOT_HPP
+#define DIRECTORY_SNAPSHOT_HPP
+
+#include <openssl/evp.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <array>
+#include <cerrno>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include "VersionManager.hpp"
+
+using Digest = std::array<unsigned char, 32>;
+
+struct SnapshotNode {
+    std::string name;
+    bool isDirectory = false;
+    Digest hash{};
+    uint64_t size = 0;
+    uint64_t inode = 0;
+    int64_t mtime = 0;
+    std::vector<SnapshotNode> children;
+};
+
+struct FileSignature {
+    uint64_t inode = 0;
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    Digest hash{};
+};
+
+struct SnapshotChange {
+    char kind;
+    std::string path;
+    bool isDirectory;
+};
+
+struct SnapshotStats {
+    size_t files = 0;
+    size_t directories = 0;
+    size_t hashed = 0;
+    size_t reused = 0;
+    uint64_t bytesHashed = 0;
+    double seconds = 0.0;
+};
+
+class DirectorySnapshot {
+public:
+    DirectorySnapshot(const std::string& rootPath)
+        : rootPath(rootPath), storeDir(std::filesystem::path(rootPath) / ".versions" / "snapshots") {}
+
+    std::string capture(SnapshotNode& tree, SnapshotStats& stats) {
+        auto start = std::chrono::steady_clock::now();
+        std::filesystem::create_directories(storeDir);
+        loadSignatures();
+
+        tree = SnapshotNode();
+        tree.name = ".";
+        tree.isDirectory = true;
+        struct stat root;
+        device = stat(rootPath.c_str(), &root) == 0 ? root.st_dev : 0;
+        walk(tree, rootPath, stats);
+
+        std::vector<HashJob> jobs;
+        std::unordered_map<std::string, FileSignature> updated;
+        collectJobs(tree, "", jobs, updated, stats);
+        hashInParallel(jobs, stats);
+        computeDirectoryHashes(tree);
+
+        for (const auto& job : jobs) {
+            if (!job.hashed) continue;
+            FileSignature signature = job.signature;
+            signature.hash = job.node->hash;
+            updated[job.relativePath] = signature;
+        }
+        signatures.swap(updated);
+        saveSignatures();
+
+        std::string name = currentTimestamp();
+        for (int suffix = 2; std::filesystem::exists(storeDir / (name + ".snap")); ++suffix) {
+            name = currentTimestamp() + "-" + std::to_string(suffix);
+        }
+        save(tree, name);
+        prune(name);
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return name;
+    }
+
+    std::vector<std::string> listSnapshots() const {
+        std::vector<std::string> names;
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(storeDir, ec)) {
+            if (entry.path().extension() == ".snap") {
+                names.push_back(entry.path().stem().string());
+            }
+        }
+        std::sort(names.begin(), names.end());
+        return names;
+    }
+
+    bool load(const std::string& name, SnapshotNode& tree) const {
+        std::ifstream in(storeDir / (name + ".snap"));
+        if (!in) return false;
+        tree = SnapshotNode();
+        return readNode(in, tree);
+    }
+
+    static std::vector<SnapshotChange> compare(const SnapshotNode& before, const SnapshotNode& after) {
+        std::vector<SnapshotChange> changes;
+        if (before.hash != after.hash) {
+            compareChildren(before, after, "", changes);
+        }
+        return changes;
+    }
+
+    static std::string toHex(const Digest& digest) {
+        static const char* hex = "0123456789abcdef";
+        std::string out(64, '0');
+        for (size_t i = 0; i < digest.size(); ++i) {
+            out[2 * i] = hex[digest[i] >> 4];
+            out[2 * i + 1] = hex[digest[i] & 0xF];
+        }
+        return out;
+    }
+
+private:
+    struct HashJob {
+        SnapshotNode* node;
+        std::string relativePath;
+        FileSignature signature;
+        bool hashed = false;
+    };
+
+    std::string rootPath;
+    dev_t device = 0;
+    std::filesystem::path storeDir;
+    std::unordered_map<std::string, FileSignature> signatures;
+
+    void walk(SnapshotNode& node, const std::string& path, SnapshotStats& stats) {
+        DIR* dir = opendir(path.c_str());
+        if (!dir) return;
+        ++stats.directories;
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            std::string name = entry->d_name;
+            if (name == "." || name == ".." || name == ".versions" || name == "RESUME_DATA") continue;
+            if (name.find('\n') != std::string::npos) continue;
+
+            struct stat st;
+            std::string childPath = path + "/" + name;
+            if (lstat(childPath.c_str(), &st) != 0 || st.st_dev != device) continue;
+
+            SnapshotNode child;
+            child.name = name;
+            child.isDirectory = S_ISDIR(st.st_mode);
+            child.size = static_cast<uint64_t>(st.st_size);
+            child.inode = static_cast<uint64_t>(st.st_ino);
+            child.mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+            if (child.isDirectory) {
+                walk(child, childPath, stats);
+            } else if (!S_ISREG(st.st_mode) && !S_ISLNK(st.st_mode)) {
+                continue;
+            }
+            node.children.push_back(std::move(child));
+        }
+        closedir(dir);
+        std::sort(node.children.begin(), node.children.end(), [](const SnapshotNode& a, const SnapshotNode& b) {
+            return a.name < b.name;
+        });
+    }
+
+    void collectJobs(SnapshotNode& node, const std::string& relative, std::vector<HashJob>& jobs,
+                     std::unordered_map<std::string, FileSignature>& retained, SnapshotStats& stats) {
+        for (auto& child : node.children) {
+            std::string childRelative = relative + child.name;
+            if (child.isDirectory) {
+                collectJobs(child, childRelative + "/", jobs, retained, stats);
+                continue;
+            }
+            ++stats.files;
+            FileSignature signature;
+            signature.inode = child.inode;
+            signature.size = child.size;
+            signature.mtime = child.mtime;
+
+            auto cached = signatures.find(childRelative);
+            if (cached != signatures.end() && cached->second.inode == signature.inode &&
+                cached->second.size == signature.size && cached->second.mtime == signature.mtime) {
+                child.hash = cached->second.hash;
+                retained[childRelative] = cached->second;
+                ++stats.reused;
+            } else {
+                jobs.push_back({&child, childRelative, signature});
+            }
+        }
+    }
+
+    void hashInParallel(std::vector<HashJob>& jobs, SnapshotStats& stats) {
+        std::atomic<size_t> next{0};
+        std::atomic<uint64_t> bytes{0};
+        unsigned workers = std::max(1u, std::min<unsigned>(std::thread::hardware_concurrency(), 16));
+        workers = std::min<unsigned>(workers, std::max<size_t>(1, jobs.size()));
+        auto worker = [&]() {
+            std::vector<char> buffer(1 << 20);
+            size_t i;
+            while ((i = next.fetch_add(1)) < jobs.size()) {
+                uint64_t hashedBytes = 0;
+                jobs[i].hashed = hashFile(rootPath + "/" + jobs[i].relativePath, jobs[i].node->hash, buffer, hashedBytes);
+                if (!jobs[i].hashed) jobs[i].node->hash = Digest{};
+                bytes += hashedBytes;
+            }
+        };
+        std::vector<std::thread> pool;
+        for (unsigned i = 1; i < workers; ++i) pool.emplace_back(worker);
+        worker();
+        for (auto& thread : pool) thread.join();
+        stats.hashed += jobs.size();
+        stats.bytesHashed += bytes;
+    }
+
+    static bool hashFile(const std::string& path, Digest& digest, std::vector<char>& buffer, uint64_t& total) {
+        EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+        EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr);
+        bool ok = false;
+        struct stat st;
+        if (lstat(path.c_str(), &st) == 0 && S_ISLNK(st.st_mode)) {
+            ssize_t length = readlink(path.c_str(), buffer.data(), buffer.size());
+            ok = length >= 0;
+            if (length > 0) EVP_DigestUpdate(ctx, buffer.data(), static_cast<size_t>(length));
+        } else {
+            int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd >= 0) {
+                posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+                ssize_t got;
+                ok = true;
+                while ((got = read(fd, buffer.data(), buffer.size())) != 0) {
+                    if (got < 0) {
+                        if (errno == EINTR) continue;
+                        ok = false;
+                        break;
+                    }
+                    EVP_DigestUpdate(ctx, buffer.data(), static_cast<size_t>(got));
+                    total += static_cast<uint64_t>(got);
+                }
+                close(fd);
+            }
+        }
+        unsigned int length = 0;
+        EVP_DigestFinal_ex(ctx, digest.data(), &length);
+        EVP_MD_CTX_free(ctx);
+        return ok;
+    }
+
+    static void computeDirectoryHashes(SnapshotNode& node) {
+        EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+        EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr);
+        for (auto& child : node.children) {
+            if (child.isDirectory) computeDirectoryHashes(child);
+            char type = child.isDirectory ? 'D' : 'F';
+            EVP_DigestUpdate(ctx, &type, 1);
+            EVP_DigestUpdate(ctx, child.name.c_str(), child.name.size() + 1);
+            EVP_DigestUpdate(ctx, child.hash.data(), child.hash.size());
+        }
+        unsigned int length = 0;
+        EVP_DigestFinal_ex(ctx, node.hash.data(), &length);
+        EVP_MD_CTX_free(ctx);
+    }
+
+    static void compareChildren(const SnapshotNode& before, const SnapshotNode& after, const std::string& prefix, std::vector<SnapshotChange>& changes) {
+        size_t i = 0, j = 0;
+        while (i < before.children.size() || j < after.children.size()) {
+            const SnapshotNode* old = i < before.children.size() ? &before.children[i] : nullptr;
+            const SnapshotNode* cur = j < after.children.size() ? &after.children[j] : nullptr;
+            if (cur == nullptr || (old != nullptr && old->name < cur->name)) {
+                changes.push_back({'-', prefix + old->name, old->isDirectory});
+                ++i;
+            } else if (old == nullptr || cur->name < old->name) {
+                changes.push_back({'+', prefix + cur->name, cur->isDirectory});
+                ++j;
+            } else {
+                if (old->hash != cur->hash) {
+                    if (old->isDirectory && cur->isDirectory) {
+                        compareChildren(*old, *cur, prefix + cur->name + "/", changes);
+                    } else {
+                        changes.push_back({'~', prefix + cur->name, cur->isDirectory});
+                    }
+                }
+                ++i;
+                ++j;
+            }
+        }
+    }
+
+    static int hexValue(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    static bool fromHex(const std::string& hex, Digest& digest) {
+        if (hex.size() != 64) return false;
+        for (size_t i = 0; i < digest.size(); ++i) {
+            int high = hexValue(hex[2 * i]);
+            int low = hexValue(hex[2 * i + 1]);
+            if (high < 0 || low < 0) return false;
+            digest[i] = static_cast<unsigned char>(high << 4 | low);
+        }
+        return true;
+    }
+
+    void prune(const std::string& head) const {
+        std::vector<std::string> names = listSnapshots();
+        std::set<std::string> keep = VersionPack::selectRetained({names.begin(), names.end()}, head, RetentionPolicy());
+        std::error_code ec;
+        for (const auto& name : names) {
+            if (!keep.count(name)) std::filesystem::remove(storeDir / (name + ".snap"), ec);
+        }
+    }
+
+    void save(const SnapshotNode& tree, const std::string& name) const {
+        std::filesystem::path target = storeDir / (name + ".snap");
+        std::ofstream out(target.string() + ".tmp");
+        writeNode(out, tree);
+        out.close();
+        std::filesystem::rename(target.string() + ".tmp", target);
+    }
+
+    static void writeNode(std::ostream& out, const SnapshotNode& node) {
+        out << (node.isDirectory ? 'D' : 'F') << ' ' << toHex(node.hash) << ' ' << node.size << ' '
+            << node.children.size() << ' ' << node.name << '\n';
+        for (const auto& child : node.children) writeNode(out, child);
+    }
+
+    static bool readNode(std::istream& in, SnapshotNode& node) {
+        std::string line;
+        if (!std::getline(in, line)) return false;
+        std::istringstream iss(line);
+        char type;
+        std::string hex;
+        size_t childCount = 0;
+        if (!(iss >> type >> hex >> node.size >> childCount)) return false;
+        iss.get();
+        std::getline(iss, node.name);
+        node.isDirectory = (type == 'D');
+        if (!fromHex(hex, node.hash)) return false;
+        node.children.resize(childCount);
+        for (auto& child : node.children) {
+            if (!readNode(in, child)) return false;
+        }
+        return true;
+    }
+
+    void loadSignatures() {
+        signatures.clear();
+        std::ifstream in(storeDir / "SIGNATURES");
+        std::string line;
+        while (std::getline(in, line)) {
+            std::istringstream iss(line);
+            FileSignature signature;
+            std::string hex, path;
+            if (!(iss >> signature.inode >> signature.size >> signature.mtime >> hex)) continue;
+            iss.get();
+            std::getline(iss, path);
+            if (fromHex(hex, signature.hash)) signatures[path] = signature;
+        }
+    }
+
+    void saveSignatures() const {
+        std::filesystem::path target = storeDir / "SIGNATURES";
+        std::ofstream out(target.string() + ".tmp");
+        for (const auto& [path, signature] : signatures) {
+            out << signature.inode << ' ' << signature.size << ' ' << signature.mtime << ' '
+                << toHex(signature.hash) << ' ' << path << '\n';
+        }
+        out.close();
+        std::filesystem::rename(target.string() + ".tmp", target);
+    }
+
+    static std::string currentTimestamp() {
+        auto now = std::chrono::system_clock::now();
+        std::time_t timeNow = std::chrono::system_clock::to_time_t(now);
+        std::tm tm = *std::localtime(&timeNow);
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count() % 1000000;
+        char buffer[32];
+        size_t length = std::strftime(buffer, sizeof(buffer), "%Y%m%d%H%M%S", &tm);
+        snprintf(buffer + length, sizeof(buffer) - length, ".%06lld", static_cast<long long>(micros));
+        return std::string(buffer);
+    }
+};
+#endif
@@ -11,99 +11,82 @@
 #include <limits.h>
 #include <algorithm>
 #include <cstring>
+#include <cstdint>
+#include <functional>
 #include <errno.h>
+#include <poll.h>
 #include "TextEditor.hpp"
 #include "FileSearcher.hpp"
 #include "Torrent.hpp"
 #include "FileSharingServer.hpp"
 #include "FileSharingClient.hpp"
+#include "TransferEngine.hpp"
+#include "DirectorySnapshot.hpp"
+#include "DirectoryLoader.hpp"
+#include "DirectorySizer.hpp"
 
-void receiveFile(std::string path) {
+void receiveFile(std::string path, TransferEngine& transfers) {
     ServerUI UI;
     std::string localIP = NetworkUtils::getLocalIP();
-    std::string encodedIP = Base64Encoder::encodeIP(localIP);
     std::string filename = UI.getFilename();
-    UI.displaySessionID(encodedIP);
-    Server server(8080);
-    server.acceptConnection();
-    server.receiveFile(path + "/" + filename);
-    UI.showCompletionMessage();
-    UI.waitForExit();
-}
-
-void sendFile(std::string filename) {
-    ClientUI UI;
-    std::string encodedIP = UI.getSessionID();
-    std::string decodedIP = Base64Decoder::decodeIP(encodedIP);
-    FileTransferClient client(decodedIP, 8080, filename);
-    client.connectToServer();
-    client.sendFile();
-    UI.showMessage("Transfer Complete!");
-    UI.waitForExit();
-}
-
-void displayDownloadStatus(const std::string& torrentName, float progress, int peers, float speed, bool completed) {
-    clear();
-    int height, width;
-    getmaxyx(stdscr, height, width);
-    mvprintw(height / 4, (width - 11) / 2, "DOWNLOADING");
-    mvprintw(height / 4 + 1, (width - 38) / 2, "When you leave, download will be paused");
-    mvprintw((height / 4) + 4, (width - (torrentName.size()) + 9) / 2, "Torrent: %s", torrentName.c_str());
-    mvprintw((height / 4) + 5, (width - 40) / 2, "Speed: %.2f KB/s | Peers: %d | Progress: %.2f%%", speed, peers, progress);
-    if (completed) {
-        mvprintw(height - 1, 0, "Download completed!");
-    } else {
-        mvprintw(height - 1, 0, "Press ESC to exit");
+    auto server = std::make_unique<Server>(NetworkUtils::configuredPort());
+    if (!server->isListening()) {
+        UI.showMessage(server->getLastError());
+        UI.waitForExit();
+        return;
     }
-    refresh();
+    UI.displaySessionID(Base64Encoder::encodeSession(localIP, server->getPort()));
+    transfers.receive(std::move(server), path + "/" + filename);
+    UI.showMessage("Waiting for the sender in the background (Ctrl+W shows transfers)");
+    UI.waitForExit();
 }
 
-void runTorrentDownload(const std::string& input) {
-    auto session = std::make_shared<libtorrent::session>();
-    configureSession(session);
-    Torrent torrent(session, input);
-    curs_set(0);
-    initscr();
-    cbreak();
-    noecho();
-    keypad(stdscr, TRUE);
-    nodelay(stdscr, FALSE);
-
-    if (!torrent.verifyTorrent(input)) {
-        clear();
-        int height, width;
-        getmaxyx(stdscr, height, width);
-        mvprintw((height / 2), (width - 22) / 2, "Invalid torrent file.");
-        mvprintw((height / 2) + 1, (width - 22) / 2, "Press any key to exit.");
-        refresh();
-        getch();
-        endwin();
+void runReceiveDaemon(std::string path) {
+    ServerUI UI;
+    ReceiveDaemon daemon(path, NetworkUtils::configuredPort());
+    if (!daemon.start()) {
+        UI.showMessage(daemon.getLastError());
+        UI.waitForExit();
         return;
     }
+    std::string sessionID = Base64Encoder::encodeSession(NetworkUtils::getLocalIP(), daemon.getPort());
+    PeerAnnouncer announcer(daemon.getPort(), NetworkUtils::hostName());
+    announcer.start();
+    timeout(500);
+    int ch;
+    do {
+        UI.showTransferTable(sessionID, daemon.snapshot());
+        ch = getch();
+    } while (ch != 'q' && ch != 27);
+    timeout(-1);
+    announcer.stop();
+    daemon.stop();
+}
 
-    bool userExited = false;
-    while (!torrent.isCompleted()) {
-        torrent.handleAlerts();
-        auto [progress, peers, speed] = torrent.getTorrentStatus();
-        std::string torrentName = torrent.getTorrentName();
-        
-        displayDownloadStatus(torrentName, progress, peers, speed, false);
-        std::this_thread::sleep_for(std::chrono::seconds(1));
-        
-        int ch = getch();
-        if (ch == 27) {
-            userExited = true;
-            break;
+void sendFile(std::string filename, TransferEngine& transfers) {
+    ClientUI UI;
+    PeerBrowser browser;
+    DiscoveredPeer peer;
+    ClientUI::PickResult picked = browser.start() ? UI.pickPeer(browser, peer) : ClientUI::Manual;
+    browser.stop();
+    if (picked == ClientUI::Cancelled) return;
+    struct sockaddr_storage address{};
+    socklen_t length = 0;
+    if (picked == ClientUI::Picked) {
+        PeerDiscovery::fastestPath(peer, address, length);
+    } else {
+        std::string encodedIP = UI.getSessionID();
+        std::string decodedIP;
+        int port;
+        Base64Decoder::decodeSession(encodedIP, decodedIP, port);
+        if (!TransferProtocol::parseAddress(decodedIP, port, address, length)) {
+            UI.showMessage("Invalid session ID");
+            UI.waitForExit();
+            return;
         }
     }
-    if (torrent.isCompleted()) {
-        displayDownloadStatus(torrent.getTorrentName(), 100.0f, 0, 0.0f, true);
-        std::this_thread::sleep_for(std::chrono::seconds(1));
-    } else if (userExited) {
-        torrent.stopDownload();
-    }
-    curs_set(1);
-    endwin();
+    bool delta = UI.askYesNo("Delta mode");
+    transfers.send(address, length, filename, delta);
 }
 
 void fileSearcher(std::string pathname) {
@@ -122,31 +105,21 @@ void textEditor(std::string filename) {
     endwin();
 }
 
-class Node {
-public:
-    std::string name;
-    bool isDirectory;
-    std::vector<Node*> children;
-
-    Node(const std::string& name, bool isDir) : name(name), isDirectory(isDir) {}
-};
-
 class DirectoryTree {
 private:
-    Node* root;
+    DirectoryLoader loader;
+    std::shared_ptr<DirectoryListing> listing;
+    std::vector<uint32_t> order;
+    std::string rootPath;
     std::string currentPath;
-    Node* currentNode;
 
 public:
-    DirectoryTree(const std::string& initialPath = ".") : root(new Node(".", true)) {
-        if (chdir(initialPath.c_str()) == 0) {
-            currentPath = getCurrentPath();
-        } else {
+    DirectoryTree(const std::string& initialPath = ".") {
+        if (chdir(initialPath.c_str()) != 0) {
             std::cerr << "Invalid path! Defaulting to the current directory." << std::endl;
-            currentPath = getCurrentPath();
         }
-        currentNode = root;
-        loadDirectory(root, currentPath);
+        rootPath = currentPath = getCurrentPath();
+        listing = loader.open(currentPath, false);
     }
 
     std::string getCurrentPath() {
@@ -154,67 +127,97 @@ public:
         return getcwd(buffer, sizeof(buffer)) ? std::string(buffer) : ".";
     }
 
-    void loadDirectory(Node* node, const std::string& path) {
-        node->children.clear();
-        node->children.push_back(new Node("..", true));
+    void enterDirectory(const std::string& dirName) {
+        if (dirName == ".." && currentPath == rootPath) return;
+        std::string newPath = dirName == ".." ? ".." : currentPath + "/" + dirName;
+        if (chdir(newPath.c_str()) != 0) return;
+        currentPath = getCurrentPath();
+        listing = loader.open(currentPath, false);
+        order.clear();
+    }
 
-        DIR* dir = opendir(path.c_str());
-        if (!dir) {
-            mvprintw(0, 0, "Failed to open directory: %s", path.c_str());
-            return;
-        }
+    int count() const {
+        return static_cast<int>(listing->entries.size());
+    }
 
-        struct dirent* entry;
-        while ((entry = readdir(dir)) != nullptr) {
-            std::string name = entry->d_name;
-            if (name == "." || name == ".." || name == ".versions" || name == "RESUME_DIR") continue;
+    const DirectoryEntry& entryAt(int index) const {
+        index = std::clamp(index, 0, count() - 1);
+        return listing->entries[order.empty() ? index : order[index]];
+    }
 
-            bool isDir = (entry->d_type == DT_DIR);
-            node->children.push_back(new Node(name, isDir));
-        }
-        closedir(dir);
+    const DirectoryListing* getListing() const {
+        return listing.get();
+    }
 
-        std::sort(node->children.begin(), node->children.end(), [](Node* a, Node* b) {
-            if (a->isDirectory && !b->isDirectory) return true;
-            if (!a->isDirectory && b->isDirectory) return false;
-            return a->name < b->name;
-        });
+    const std::string& getError() const {
+        return listing->error;
     }
 
-    void enterDirectory(const std::string& dirName) {
-        if (dirName == "..") {
-            if (currentNode != root) {
-                chdir("..");
-                currentPath = getCurrentPath();
-                loadDirectory(currentNode, currentPath);
-            }
-        } else {
-            std::string newPath = currentPath + "/" + dirName;
-            if (chdir(newPath.c_str()) == 0) {
-                for (Node* child : currentNode->children) {
-                    if (child->name == dirName && child->isDirectory) {
-                        currentNode = child;
-                        if (child->children.empty()) {
-                            loadDirectory(child, newPath);
-                        }
-                        break;
-                    }
-                }
-            }
-            currentPath = getCurrentPath();
+    std::string getCurrentPathStr() const {
+        return currentPath;
+    }
+
+    bool isLoading() {
+        return loader.isLoading();
+    }
+
+    int getUpdateFd() const {
+        return loader.getUpdateFd();
+    }
+
+    bool poll() {
+        if (!loader.poll()) return false;
+        order.clear();
+        return true;
+    }
+
+    bool sortedBySize() const {
+        return !order.empty();
+    }
+
+    void sortBySize(const std::function<int64_t(const DirectoryEntry&)>& sizeOf) {
+        std::vector<int64_t> sizes(listing->entries.size());
+        order.resize(listing->entries.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            order[i] = static_cast<uint32_t>(i);
+            const DirectoryEntry& entry = listing->entries[i];
+            sizes[i] = entry.inode == 0 ? INT64_MAX : entry.isDirectory ? sizeOf(entry) : -1;
         }
+        std::stable_sort(order.begin(), order.end(), [&sizes](uint32_t a, uint32_t b) { return sizes[a] > sizes[b]; });
     }
 
-    const std::vector<Node*>& getCurrentEntries() const {
-        return currentNode->children;
+    void sortByName() {
+        order.clear();
     }
 
-    std::string getCurrentPathStr() const {
-        return currentPath;
+    const char* name(const DirectoryEntry& entry) const {
+        return listing->name(entry);
+    }
+
+    std::string nameAt(int index) const {
+        return listing->name(entryAt(index));
+    }
+
+    int indexOf(const std::string& name, bool isDirectory) const {
+        if (!order.empty()) {
+            for (size_t i = 0; i < order.size(); ++i) {
+                if (name == listing->name(listing->entries[order[i]])) return static_cast<int>(i);
+            }
+            return -1;
+        }
+        uint64_t key = DirectoryLoader::sortKey(name.c_str(), name.size(), isDirectory);
+        auto it = std::lower_bound(listing->entries.begin(), listing->entries.end(), key,
+                                   [this, &name](const DirectoryEntry& entry, uint64_t key) {
+            if (entry.sortKey != key) return entry.sortKey < key;
+            return strcmp(listing->name(entry), name.c_str()) < 0;
+        });
+        if (it == listing->entries.end() || it->sortKey != key || name != listing->name(*it)) return -1;
+        return static_cast<int>(it - listing->entries.begin());
     }
 
     void refresh() {
-        loadDirectory(currentNode, currentPath);
+        listing = loader.open(currentPath, true);
+        order.clear();
     }
 };
 
@@ -223,9 +226,31 @@ private:
     DirectoryTree dirTree;
     int selected = 0;  
     int offset = 0;    
+    TransferEngine transfers;
+    TorrentManager torrents;
+    DirectorySizer sizer;
+    const DirectoryListing* sizedListing = nullptr;
+
+    struct DrawnRow {
+        std::string label;
+        std::string size;
+        bool selected = false;
+        bool used = false;
+        bool valid = false;
+    };
+
+    WINDOW* listWin = nullptr;
+    int viewHeight = 0;
+    int viewWidth = 0;
+    int listRows = 1;
+    int drawnOffset = 0;
+    const DirectoryListing* drawnListing = nullptr;
+    std::vector<DrawnRow> drawnRows;
+    bool viewDirty = true;
 
 public:
     FileExplorer(const std::string& initialPath) : dirTree(initialPath) {
+        torrents.restore();
         initscr();
         keypad(stdscr, TRUE);
         noecho();
@@ -234,25 +259,482 @@ public:
     }
 
     ~FileExplorer() {
+        if (listWin) delwin(listWin);
         endwin();
     }
 
     void displayEntries() {
-        clear();
         int maxHeight, maxWidth;
         getmaxyx(stdscr, maxHeight, maxWidth);
+        if (!listWin || maxHeight != viewHeight || maxWidth != viewWidth) createView(maxHeight, maxWidth);
+        clampSelection();
+        if (viewDirty) {
+            erase();
+            clearok(curscr, TRUE);
+            touchwin(listWin);
+            std::fill(drawnRows.begin(), drawnRows.end(), DrawnRow{});
+            viewDirty = false;
+        }
+        move(0, 0);
+        clrtoeol();
         mvprintw(0, 0, ": %s", dirTree.getCurrentPathStr().c_str());
-        const auto& entries = dirTree.getCurrentEntries();
-        int visibleLines = std::min(maxHeight - 4, static_cast<int>(entries.size()));
-
-        for (int i = 0; i < visibleLines; ++i) {
-            int entryIndex = i + offset;
-            if (entryIndex >= entries.size()) break;
-            if (entryIndex == selected) attron(A_REVERSE);
-            mvprintw(i + 2, 0, "%s%s", entries[entryIndex]->name.c_str(), entries[entryIndex]->isDirectory ? "/" : "");
-            if (entryIndex == selected) attroff(A_REVERSE);
+        move(1, 0);
+        clrtoeol();
+        if (!dirTree.getError().empty()) {
+            mvprintw(1, 0, "%s", dirTree.getError().c_str());
+        } else if (dirTree.isLoading()) {
+            mvprintw(1, 0, "Loading... %d entries so far", dirTree.count() - 1);
+        } else if (size_t pending = sizer.pendingCount()) {
+            mvprintw(1, 0, "Measuring %zu directories...%s", pending, dirTree.sortedBySize() ? " (sorted by size)" : "");
+        } else if (dirTree.sortedBySize()) {
+            mvprintw(1, 0, "Sorted by size");
         }
+        drawList();
+        move(maxHeight - 2, 0);
+        clrtoeol();
+        showTorrentStatus(maxHeight - 2);
+        move(maxHeight - 1, 0);
+        clrtoeol();
+        showTransferStatus(maxHeight - 1);
+        wnoutrefresh(stdscr);
+        wnoutrefresh(listWin);
+        doupdate();
+    }
+
+    void createView(int height, int width) {
+        if (listWin) delwin(listWin);
+        viewHeight = height;
+        viewWidth = width;
+        listRows = std::max(height - 4, 1);
+        listWin = newwin(listRows, width, 2, 0);
+        scrollok(listWin, TRUE);
+        idlok(listWin, TRUE);
+        drawnRows.assign(listRows, DrawnRow{});
+        drawnListing = nullptr;
+        viewDirty = true;
+        keepSelectionVisible();
+    }
+
+    void drawList() {
+        int shift = offset - drawnOffset;
+        if (dirTree.getListing() != drawnListing) {
+            std::fill(drawnRows.begin(), drawnRows.end(), DrawnRow{});
+            drawnListing = dirTree.getListing();
+        } else if (shift != 0 && std::abs(shift) < listRows) {
+            wscrl(listWin, shift);
+            if (shift > 0) {
+                std::move(drawnRows.begin() + shift, drawnRows.end(), drawnRows.begin());
+                std::fill(drawnRows.end() - shift, drawnRows.end(), DrawnRow{});
+            } else {
+                std::move_backward(drawnRows.begin(), drawnRows.end() + shift, drawnRows.end());
+                std::fill(drawnRows.begin(), drawnRows.begin() - shift, DrawnRow{});
+            }
+        } else if (shift != 0) {
+            std::fill(drawnRows.begin(), drawnRows.end(), DrawnRow{});
+        }
+        drawnOffset = offset;
+
+        int totalEntries = dirTree.count();
+        int nameWidth = std::max(viewWidth - 11, 1);
+        for (int row = 0; row < listRows; ++row) {
+            int entryIndex = offset + row;
+            DrawnRow next;
+            if (entryIndex < totalEntries) {
+                const DirectoryEntry& entry = dirTree.entryAt(entryIndex);
+                next.label = dirTree.name(entry);
+                if (entry.isDirectory) next.label += "/";
+                if (entry.isDirectory && entry.inode != 0) next.size = formatSize(entry);
+                next.selected = entryIndex == selected;
+                next.used = true;
+            }
+            DrawnRow& drawn = drawnRows[row];
+            if (drawn.valid && drawn.used == next.used && drawn.selected == next.selected && drawn.label == next.label &&
+                drawn.size == next.size) {
+                continue;
+            }
+            wmove(listWin, row, 0);
+            wclrtoeol(listWin);
+            if (next.used) {
+                if (next.selected) wattron(listWin, A_REVERSE);
+                mvwaddnstr(listWin, row, 0, next.label.c_str(), nameWidth);
+                if (next.selected) wattroff(listWin, A_REVERSE);
+                if (!next.size.empty()) mvwprintw(listWin, row, viewWidth - 10, "%10s", next.size.c_str());
+            }
+            next.valid = true;
+            drawn = std::move(next);
+        }
+    }
+
+    void moveSelection(int delta, bool page) {
+        int totalEntries = dirTree.count();
+        selected = std::clamp(selected + delta, 0, std::max(totalEntries - 1, 0));
+        if (page) offset = std::clamp(offset + delta, 0, std::max(totalEntries - listRows, 0));
+        keepSelectionVisible();
+    }
+
+    void clampSelection() {
+        selected = std::clamp(selected, 0, std::max(dirTree.count() - 1, 0));
+        offset = std::clamp(offset, 0, std::max(dirTree.count() - listRows, 0));
+        keepSelectionVisible();
+    }
+
+    void keepSelectionVisible() {
+        if (selected < offset) offset = selected;
+        if (selected >= offset + listRows) offset = selected - listRows + 1;
+    }
+
+    void showTorrentStatus(int row) {
+        std::vector<TorrentRow> rows = torrents.snapshot();
+        std::vector<TorrentCreationRow> creations = torrents.creations();
+        if (rows.empty() && creations.empty()) return;
+        size_t downloading = 0, seeding = 0, failed = 0;
+        int downloadRate = 0, uploadRate = 0;
+        for (const auto& torrent : rows) {
+            if (!torrent.error.empty()) ++failed;
+            else if (torrent.finished) ++seeding;
+            else if (!torrent.paused) ++downloading;
+            downloadRate += torrent.downloadRate;
+            uploadRate += torrent.uploadRate;
+        }
+        size_t hashing = std::count_if(creations.begin(), creations.end(), [](const TorrentCreationRow& creation) {
+            return creation.error.empty();
+        });
+        mvprintw(row, 0, "Torrents: %zu downloading, %zu seeding, %zu failed, %zu hashing (down %.1f / up %.1f KiB/s) | Ctrl+B to manage",
+                 downloading, seeding, failed, hashing, downloadRate / 1024.0, uploadRate / 1024.0);
+    }
+
+    void showTransferStatus(int row) {
+        std::vector<TransferJobRow> jobs = transfers.snapshot();
+        if (jobs.empty()) return;
+        size_t active = 0, failed = 0;
+        uint64_t done = 0, total = 0;
+        double rate = 0;
+        for (const auto& job : jobs) {
+            if (job.active) {
+                ++active;
+                done += job.done;
+                total += job.total;
+                rate += job.rate;
+            } else if (!job.error.empty()) {
+                ++failed;
+            }
+        }
+        mvprintw(row, 0, "Transfers: %zu active (%.1f / %.1f MiB, %.1f MiB/s), %zu failed | Ctrl+W to manage",
+                 active, done / 1048576.0, total / 1048576.0, rate / 1048576.0, failed);
+    }
+
+    void showTransfers() {
+        size_t chosen = 0;
+        timeout(500);
+        while (true) {
+            std::vector<TransferJobRow> jobs = transfers.snapshot();
+            if (!jobs.empty()) chosen = std::min(chosen, jobs.size() - 1);
+            erase();
+            int height = getmaxy(stdscr);
+            mvprintw(0, 0, "Transfers | c: cancel  x: clear finished  q: back");
+            mvprintw(2, 0, "%-4s %-30s %-10s %8s %8s  %s", "Dir", "Name", "State", "Done", "MiB/s", "Error");
+            for (size_t i = 0; i < jobs.size() && static_cast<int>(i) + 3 < height - 6; ++i) {
+                const auto& job = jobs[i];
+                double percent = job.total > 0 ? 100.0 * job.done / job.total : 0.0;
+                if (i == chosen) attron(A_REVERSE);
+                mvprintw(3 + i, 0, "%-4s %-30.30s %-10s %7.1f%% %8.1f  %s", job.sending ? "out" : "in",
+                         job.name.c_str(), job.state.c_str(), percent, job.rate / 1048576.0, job.error.c_str());
+                if (i == chosen) attroff(A_REVERSE);
+            }
+            if (!jobs.empty()) {
+                for (size_t i = 0; i < jobs[chosen].details.size(); ++i) {
+                    mvprintw(height - 5 + i, 0, "%s", jobs[chosen].details[i].c_str());
+                }
+            }
+            refresh();
+
+            int ch = getch();
+            if (ch == KEY_UP && chosen > 0) {
+                --chosen;
+            } else if (ch == KEY_DOWN && chosen + 1 < jobs.size()) {
+                ++chosen;
+            } else if (ch == 'c' && !jobs.empty()) {
+                transfers.cancel(jobs[chosen].id);
+            } else if (ch == 'x') {
+                transfers.clearFinished();
+            } else if (ch == 'q' || ch == 27) {
+                break;
+            }
+        }
+        timeout(-1);
+    }
+
+    static std::string formatEta(int64_t seconds) {
+        if (seconds < 0) return "-";
+        char text[32];
+        if (seconds >= 3600) {
+            snprintf(text, sizeof(text), "%lldh%02lldm", static_cast<long long>(seconds / 3600), static_cast<long long>(seconds / 60 % 60));
+        } else {
+            snprintf(text, sizeof(text), "%lldm%02llds", static_cast<long long>(seconds / 60), static_cast<long long>(seconds % 60));
+        }
+        return text;
+    }
+
+    int waitForKeyOrTorrentUpdate() {
+        nodelay(stdscr, TRUE);
+        int ch = getch();
+        nodelay(stdscr, FALSE);
+        if (ch != ERR) return ch;
+        struct pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {torrents.getUpdateFd(), POLLIN, 0}};
+        while (poll(fds, 2, -1) < 0 && errno == EINTR) {}
+        torrents.drainUpdates();
+        return (fds[0].revents & POLLIN) ? getch() : ERR;
+    }
+
+    static std::string formatSeconds(double seconds) {
+        if (seconds < 0) return "-";
+        char text[32];
+        snprintf(text, sizeof(text), "%.1fs", seconds);
+        return text;
+    }
+
+    void showTorrents() {
+        size_t chosen = 0;
+        torrents.setLiveUpdates(true);
+        while (true) {
+            std::vector<TorrentRow> rows = torrents.snapshot();
+            if (!rows.empty()) chosen = std::min(chosen, rows.size() - 1);
+            erase();
+            int height = getmaxy(stdscr);
+            mvprintw(0, 0, "Torrents | p: pause/resume  +/-: queue order  d: remove (keeps files)  f: files  s: sequential  "
+                           "l: limits  o: next profile  q: back");
+            mvprintw(2, 0, "%-30s %-11s %7s %10s %10s %9s %9s  %s", "Name", "State", "Done", "Down KiB/s", "Up KiB/s",
+                     "Peers", "ETA", "Error");
+            for (size_t i = 0; i < rows.size() && static_cast<int>(i) + 3 < height - 5; ++i) {
+                const auto& torrent = rows[i];
+                std::string peers = std::to_string(torrent.peers) + "(" + std::to_string(torrent.seeds) + ")";
+                if (i == chosen) attron(A_REVERSE);
+                mvprintw(3 + i, 0, "%-30.30s %-11s %6.1f%% %10.1f %10.1f %9s %9s  %s", torrent.name.c_str(),
+                         torrent.state.c_str(), torrent.progress, torrent.downloadRate / 1024.0,
+                         torrent.uploadRate / 1024.0, peers.c_str(), formatEta(torrent.eta).c_str(), torrent.error.c_str());
+                if (i == chosen) attroff(A_REVERSE);
+            }
+            std::vector<TorrentCreationRow> creations = torrents.creations();
+            int line = 3 + static_cast<int>(rows.size());
+            for (size_t i = 0; i < creations.size() && line < height - 5; ++i, ++line) {
+                const auto& creation = creations[i];
+                if (!creation.error.empty()) {
+                    mvprintw(line, 0, "%-30.30s %-11s %s", creation.name.c_str(), "error", creation.error.c_str());
+                } else {
+                    mvprintw(line, 0, "%-30.30s %-11s %6.1f%%  %d/%d pieces", creation.name.c_str(), "hashing",
+                             creation.pieces > 0 ? 100.0 * creation.piecesDone / creation.pieces : 0.0,
+                             creation.piecesDone, creation.pieces);
+                }
+            }
+            if (rows.empty() && creations.empty()) {
+                mvprintw(3, 0, "No torrents. Press Enter on a .torrent file to add one, or Ctrl+P to share the selected entry.");
+            }
+            if (!rows.empty()) {
+                const auto& torrent = rows[chosen];
+                mvprintw(height - 4, 0, "Startup: first peer after %s, full rate after %s (peak %.1f KiB/s) | limits %s down, %s up%s",
+                         formatSeconds(torrent.firstPeerSeconds).c_str(), formatSeconds(torrent.fullRateSeconds).c_str(),
+                         torrent.peakRate / 1024.0, formatLimit(torrent.downloadLimit).c_str(),
+                         formatLimit(torrent.uploadLimit).c_str(), torrent.sequential ? " | sequential" : "");
+            }
+            TorrentSessionStats stats = torrents.sessionStats();
+            if (!stats.profile.empty()) {
+                mvprintw(height - 3, 0, "Profile %s, %s start | down %.1f / up %.1f MiB/s | %lld peers, %lld unchoked | %lld DHT nodes%s%s",
+                         stats.profile.c_str(), stats.warmStart ? "warm" : "cold", stats.downloadRate / 1048576.0,
+                         stats.uploadRate / 1048576.0, static_cast<long long>(stats.peers),
+                         static_cast<long long>(stats.unchoked), static_cast<long long>(stats.dhtNodes),
+                         stats.schedule.empty() ? "" : " | schedule ", stats.schedule.c_str());
+                mvprintw(height - 2, 0, "Disk: %lld queued jobs, %.1f MiB queued writes, %lld blocks hashed | read %.1fs write %.1fs hash %.1fs",
+                         static_cast<long long>(stats.diskJobs), stats.diskQueuedBytes / 1048576.0,
+                         static_cast<long long>(stats.blocksHashed), stats.readSeconds, stats.writeSeconds, stats.hashSeconds);
+                if (!stats.configError.empty()) mvprintw(height - 1, 0, "%s", stats.configError.c_str());
+            }
+            refresh();
+
+            int ch = waitForKeyOrTorrentUpdate();
+            if (ch == KEY_UP && chosen > 0) {
+                --chosen;
+            } else if (ch == KEY_DOWN && chosen + 1 < rows.size()) {
+                ++chosen;
+            } else if (ch == 'p' && !rows.empty()) {
+                torrents.togglePause(rows[chosen].id);
+            } else if ((ch == '+' || ch == '-') && !rows.empty()) {
+                torrents.moveInQueue(rows[chosen].id, ch == '+');
+            } else if (ch == 'd' && !rows.empty()) {
+                torrents.removeTorrent(rows[chosen].id);
+            } else if (ch == 'f' && !rows.empty()) {
+                showFilePicker(rows[chosen].id);
+            } else if (ch == 's' && !rows.empty()) {
+                torrents.toggleSequential(rows[chosen].id);
+            } else if (ch == 'l' && !rows.empty()) {
+                promptLimits(rows[chosen].id);
+            } else if (ch == 'o') {
+                torrents.cycleProfile();
+            } else if (ch == 'q' || ch == 27) {
+                break;
+            }
+        }
+        torrents.setLiveUpdates(false);
+    }
+
+    static std::string formatLimit(int bytesPerSecond) {
+        if (bytesPerSecond <= 0) return "unlimited";
+        return std::to_string(bytesPerSecond / 1024) + " KiB/s";
+    }
+
+    void promptLimits(uint64_t id) {
+        int height = getmaxy(stdscr);
+        move(height - 1, 0);
+        clrtoeol();
+        echo();
+        mvprintw(height - 1, 0, "Limits in KiB/s as down/up (0 = unlimited): ");
+        char input[64] = {0};
+        getnstr(input, sizeof(input) - 1);
+        noecho();
+        int downloadKiB, uploadKiB;
+        if (sscanf(input, "%d/%d", &downloadKiB, &uploadKiB) == 2) torrents.setLimits(id, downloadKiB, uploadKiB);
+    }
+
+    void showFilePicker(uint64_t id) {
+        size_t chosen = 0, top = 0;
+        while (true) {
+            std::vector<TorrentFileRow> files = torrents.files(id);
+            erase();
+            int height = getmaxy(stdscr);
+            mvprintw(0, 0, "Files | space: skip/normal/high  a: all  n: none  q: back");
+            if (files.empty()) {
+                mvprintw(2, 0, "Waiting for torrent metadata...");
+            } else {
+                chosen = std::min(chosen, files.size() - 1);
+                size_t visible = static_cast<size_t>(std::max(height - 3, 1));
+                if (chosen < top) top = chosen;
+                if (chosen >= top + visible) top = chosen - visible + 1;
+                for (size_t i = top; i < files.size() && i < top + visible; ++i) {
+                    const auto& file = files[i];
+                    const char* priority = file.priority == TorrentManager::kSkip ? "skip"
+                                           : file.priority >= TorrentManager::kHigh ? "high" : "normal";
+                    double done = file.size > 0 ? 100.0 * file.done / file.size : 100.0;
+                    if (i == chosen) attron(A_REVERSE);
+                    mvprintw(2 + (i - top), 0, "[%-6s] %6.1f%% %10.1f MiB  %s", priority, done, file.size / 1048576.0,
+                             file.path.c_str());
+                    if (i == chosen) attroff(A_REVERSE);
+                }
+            }
+            refresh();
+
+            int ch = waitForKeyOrTorrentUpdate();
+            if (ch == KEY_UP && chosen > 0) {
+                --chosen;
+            } else if (ch == KEY_DOWN && chosen + 1 < files.size()) {
+                ++chosen;
+            } else if (ch == ' ' && !files.empty()) {
+                int priority = files[chosen].priority;
+                int next = priority == TorrentManager::kSkip ? TorrentManager::kNormal
+                           : priority < TorrentManager::kHigh ? TorrentManager::kHigh : TorrentManager::kSkip;
+                torrents.setFilePriority(id, files[chosen].index, next);
+            } else if (ch == 'a' || ch == 'n') {
+                for (const auto& file : files) {
+                    torrents.setFilePriority(id, file.index, ch == 'a' ? TorrentManager::kNormal : TorrentManager::kSkip);
+                }
+            } else if (ch == 'q' || ch == 27) {
+                break;
+            }
+        }
+    }
+
+    void shareAsTorrent(const std::string& path) {
+        int maxY = getmaxy(stdscr);
+        move(maxY - 1, 0);
+        clrtoeol();
+        torrents.createTorrent(path);
+        mvprintw(maxY - 1, 0, "Hashing %s in the background; it starts seeding when done (Ctrl+B shows progress).",
+                 std::filesystem::path(path).filename().c_str());
         refresh();
+        getch();
+    }
+
+    void openTorrent(const std::string& filePath) {
+        int maxY = getmaxy(stdscr);
+        move(maxY - 1, 0);
+        clrtoeol();
+        uint64_t id = 0;
+        bool added = false;
+        if (!TorrentManager::verifyTorrent(filePath)) {
+            mvprintw(maxY - 1, 0, "Invalid torrent file.");
+        } else if (!torrents.addTorrent(filePath, id)) {
+            mvprintw(maxY - 1, 0, "Could not add torrent: %s", torrents.getLastError().c_str());
+        } else {
+            added = true;
+            mvprintw(maxY - 1, 0, "Torrent added, downloading in the background (f: choose files, Ctrl+B shows torrents).");
+        }
+        refresh();
+        if (getch() == 'f' && added) showFilePicker(id);
+    }
+
+    int nextKey() {
+        followListing();
+        measureSizes();
+        nodelay(stdscr, TRUE);
+        int ch = getch();
+        nodelay(stdscr, FALSE);
+        if (ch != ERR) return ch;
+        int wait = transfers.activeCount() > 0 || torrents.activeCount() > 0 ? 1000 : -1;
+        struct pollfd fds[3] = {{STDIN_FILENO, POLLIN, 0}, {dirTree.getUpdateFd(), POLLIN, 0}, {sizer.getUpdateFd(), POLLIN, 0}};
+        while (poll(fds, 3, wait) < 0 && errno == EINTR) {}
+        if (fds[1].revents & POLLIN) followListing();
+        if (fds[2].revents & POLLIN) sizer.drainUpdates();
+        return (fds[0].revents & POLLIN) ? getch() : ERR;
+    }
+
+    void measureSizes() {
+        if (dirTree.isLoading() || dirTree.getListing() == sizedListing) return;
+        sizedListing = dirTree.getListing();
+        std::vector<std::pair<uint64_t, std::string>> directories;
+        for (int i = 0; i < dirTree.count(); ++i) {
+            const DirectoryEntry& entry = dirTree.entryAt(i);
+            if (entry.isDirectory && entry.inode != 0) directories.push_back({entry.inode, dirTree.name(entry)});
+        }
+        sizer.measure(dirTree.getCurrentPathStr(), directories);
+    }
+
+    std::string formatSize(const DirectoryEntry& entry) {
+        int64_t bytes;
+        if (!sizer.sizeOf(entry.inode, bytes)) return "...";
+        if (bytes < 0) return "-";
+        const char* units[] = {"B", "K", "M", "G", "T"};
+        double value = static_cast<double>(bytes);
+        int unit = 0;
+        while (value >= 1024 && unit < 4) {
+            value /= 1024;
+            ++unit;
+        }
+        char text[16];
+        snprintf(text, sizeof(text), unit == 0 ? "%.0f%s" : "%.1f%s", value, units[unit]);
+        return text;
+    }
+
+    void toggleSizeOrder() {
+        clampSelection();
+        std::string name = dirTree.nameAt(selected);
+        bool isDirectory = dirTree.entryAt(selected).isDirectory;
+        if (dirTree.sortedBySize()) {
+            dirTree.sortByName();
+        } else {
+            dirTree.sortBySize([this](const DirectoryEntry& entry) {
+                int64_t bytes;
+                return sizer.sizeOf(entry.inode, bytes) ? bytes : -1;
+            });
+        }
+        selected = std::max(dirTree.indexOf(name, isDirectory), 0);
+        offset = std::max(0, selected - listRows / 2);
+    }
+
+    void followListing() {
+        clampSelection();
+        std::string name = dirTree.nameAt(selected);
+        bool isDirectory = dirTree.entryAt(selected).isDirectory;
+        if (!dirTree.poll()) return;
+        selected = std::max(dirTree.indexOf(name, isDirectory), 0);
+        keepSelectionVisible();
     }
 
     void createFile() {
@@ -285,6 +767,7 @@ public:
         }
         noecho();
         dirTree.refresh();
+        clampSelection();
         refresh();
         getch();
     }
@@ -306,48 +789,138 @@ public:
         mvprintw(getmaxy(stdscr) - 1, 0, "Folder '%s' created.", folderPath.c_str());
         noecho();
         dirTree.refresh();
+        clampSelection();
         refresh();
         getch();
     }
 
-    void run() {
-        int ch;
-        while ((ch = getch()) != 'q') {
-            int maxHeight, maxWidth;
-            getmaxyx(stdscr, maxHeight, maxWidth);
+    void compactVersions() {
+        int maxY = getmaxy(stdscr);
+        move(maxY - 1, 0);
+        clrtoeol();
+        mvprintw(maxY - 1, 0, "Compacting .versions...");
+        refresh();
+        CompactionResult result;
+        try {
+            result = VersionManager::compactDirectory(dirTree.getCurrentPathStr());
+        } catch (const std::exception& e) {
+            move(maxY - 1, 0);
+            clrtoeol();
+            mvprintw(maxY - 1, 0, "Compaction failed: %s", e.what());
+            refresh();
+            getch();
+            return;
+        }
+        move(maxY - 1, 0);
+        clrtoeol();
+        mvprintw(maxY - 1, 0, "Packed %zu, pruned %zu, freed %zu inodes, %ju -> %ju payload bytes, %ju -> %ju index bytes.",
+                 result.packed, result.pruned, result.inodesFreed, result.bytesBefore, result.bytesAfter,
+                 result.indexBytesBefore, result.indexBytesAfter);
+        refresh();
+        getch();
+    }
+
+    void snapshotDirectory() {
+        int maxY = getmaxy(stdscr);
+        move(maxY - 1, 0);
+        clrtoeol();
+        mvprintw(maxY - 1, 0, "Capturing snapshot...");
+        refresh();
 
-            const auto& entries = dirTree.getCurrentEntries();
-            int totalEntries = entries.size();
-            int visibleLines = std::min(maxHeight - 4, totalEntries);
+        DirectorySnapshot snapshot(dirTree.getCurrentPathStr());
+        std::vector<std::string> previous = snapshot.listSnapshots();
+        SnapshotNode current, before;
+        SnapshotStats stats;
+        std::string name;
+        try {
+            name = snapshot.capture(current, stats);
+        } catch (const std::exception& e) {
+            move(maxY - 1, 0);
+            clrtoeol();
+            mvprintw(maxY - 1, 0, "Snapshot failed: %s", e.what());
+            refresh();
+            getch();
+            return;
+        }
 
+        std::vector<SnapshotChange> changes;
+        bool hasPrevious = !previous.empty() && previous.back() != name && snapshot.load(previous.back(), before);
+        if (hasPrevious) {
+            changes = DirectorySnapshot::compare(before, current);
+        }
+
+        int top = 0;
+        while (true) {
+            clear();
+            int height = getmaxy(stdscr);
+            mvprintw(0, 0, "Snapshot %s: %zu files, %zu hashed, %zu unchanged, %.2fs",
+                     name.c_str(), stats.files, stats.hashed, stats.reused, stats.seconds);
+            if (!hasPrevious) {
+                mvprintw(2, 0, "First snapshot of this directory.");
+            } else if (changes.empty()) {
+                mvprintw(2, 0, "No changes since %s.", previous.back().c_str());
+            } else {
+                mvprintw(1, 0, "%zu changes since %s:", changes.size(), previous.back().c_str());
+                for (int i = 0; i < height - 3 && top + i < static_cast<int>(changes.size()); ++i) {
+                    const auto& change = changes[top + i];
+                    mvprintw(i + 2, 0, "%c %s%s", change.kind, change.path.c_str(), change.isDirectory ? "/" : "");
+                }
+            }
+            mvprintw(height - 1, 0, "Use Arrow keys to scroll, any other key to return...");
+            refresh();
+
+            int ch = getch();
+            if (ch == KEY_UP && top > 0) {
+                --top;
+            } else if (ch == KEY_DOWN && top + height - 3 < static_cast<int>(changes.size())) {
+                ++top;
+            } else if (ch != KEY_UP && ch != KEY_DOWN) {
+                break;
+            }
+        }
+    }
+
+    void run() {
+        int ch;
+        while ((ch = nextKey()) != 'q') {
             switch (ch) {
                 case KEY_UP:
-                    if (selected > 0) {
-                        --selected;
-                    } else if (offset > 0) {
-                        --offset;
-                    }
+                    moveSelection(-1, false);
                     break;
 
                 case KEY_DOWN:
-                    if (selected < totalEntries - 1) {
-                        ++selected;
-                    }
-                    if (selected >= visibleLines + offset - 1 && 
-                        offset < totalEntries - visibleLines) {
-                        ++offset;
-                    }
+                    moveSelection(1, false);
+                    break;
+
+                case KEY_PPAGE:
+                    moveSelection(-listRows, true);
+                    break;
+
+                case KEY_NPAGE:
+                    moveSelection(listRows, true);
+                    break;
+
+                case KEY_HOME:
+                    moveSelection(-selected, false);
+                    break;
+
+                case KEY_END:
+                    moveSelection(dirTree.count() - 1 - selected, false);
+                    break;
+
+                case KEY_RESIZE:
+                case ERR:
                     break;
 
                 case '\n':
-                    if (entries[selected]->isDirectory) {
-                        dirTree.enterDirectory(entries[selected]->name);
+                    if (dirTree.entryAt(selected).isDirectory) {
+                        dirTree.enterDirectory(dirTree.nameAt(selected));
                         selected = 0;
                         offset = 0;
                     } else {
-                        std::string filePath = dirTree.getCurrentPathStr() + "/" + entries[selected]->name;
+                        std::string filePath = dirTree.getCurrentPathStr() + "/" + dirTree.nameAt(selected);
                         if (filePath.substr(filePath.find_last_of(".") + 1) == "torrent") {
-                            runTorrentDownload(filePath);
+                            openTorrent(filePath);
                         } else {
                             textEditor(filePath);
                         }
@@ -364,6 +937,16 @@ public:
                     break;
                     }
 
+                case 11:{
+                    compactVersions();
+                    break;
+                    }
+
+                case 20:{
+                    snapshotDirectory();
+                    break;
+                    }
+
                 case 6:{
                     std::string path = dirTree.getCurrentPathStr();
                     fileSearcher(path);
@@ -372,21 +955,50 @@ public:
 
                 case 18:{
                     std::string path = dirTree.getCurrentPathStr();
-                    receiveFile(path);
+                    receiveFile(path, transfers);
+                    break;
+                    }
+
+                case 5:{
+                    std::string path = dirTree.getCurrentPathStr();
+                    runReceiveDaemon(path);
+                    break;
+                    }
+
+                case 23:{
+                    showTransfers();
+                    break;
+                    }
+
+                case 2:{
+                    showTorrents();
+                    break;
+                    }
+
+                case 7:{
+                    toggleSizeOrder();
+                    break;
+                    }
+
+                case 16:{
+                    if (dirTree.nameAt(selected) != "..") {
+                        shareAsTorrent(dirTree.getCurrentPathStr() + "/" + dirTree.nameAt(selected));
+                    }
                     break;
                     }
 
                 case 19:{
-                    if(!(entries[selected]->isDirectory)){
-                        std::string filePath = dirTree.getCurrentPathStr() + "/" + entries[selected]->name;
-                        sendFile(filePath);
-                        break;
-                        }
+                    if (dirTree.nameAt(selected) != "..") {
+                        std::string filePath = dirTree.getCurrentPathStr() + "/" + dirTree.nameAt(selected);
+                        sendFile(filePath, transfers);
+                    }
+                    break;
                     }
 
                 default:
                     break;
             }
+            if (ch != ERR && ch < KEY_MIN) viewDirty = true;
             displayEntries();
         }
     }
@@ -99,9 +99,14 @@ private:
 
     void buildTrie() {
         try {
-            for (const auto& entry : std::filesystem::recursive_directory_iterator(searchPath)) {
-                std::string path = entry.path().string();
-                trie->insert(path);
+            auto it = std::filesystem::recursive_directory_iterator(searchPath);
+            for (auto end = std::filesystem::end(it); it != end; ++it) {
+                std::string name = it->path().filename().string();
+                if (name == ".versions") {
+                    it.disable_recursion_pending();
+                    continue;
+                }
+                trie->insert(it->path().string());
             }
         } catch (const std::filesystem::filesystem_error& e) {
             std::lock_guard<std::mutex> lock(mtx);
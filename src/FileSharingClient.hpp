@@ -10,6 +10,20 @@
 #include <fstream>
 #include <sstream>
 #include <ncurses.h>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <filesystem>
+#include <memory>
+#include <chrono>
+#include <sys/ioctl.h>
+#include "FileSharingProtocol.hpp"
+#include "StreamCompression.hpp"
+#include "ChunkVerifier.hpp"
+#include "DeltaTransfer.hpp"
+#include "TreeTransfer.hpp"
+#include "PeerDiscovery.hpp"
 
 class Base64Decoder {
 public:
@@ -55,45 +69,370 @@ public:
         }
         return output;
     }
+
+    static void decodeSession(const std::string& sessionID, std::string& ip, int& port) {
+        size_t separator = std::string::npos;
+        size_t groups = 0;
+        for (size_t i = 0; i < sessionID.size(); ++i) {
+            if (sessionID[i] == '-' && ++groups == 4) {
+                separator = i;
+                break;
+            }
+        }
+        if (separator == std::string::npos) {
+            ip = decodeIP(sessionID);
+            port = 8080;
+        } else {
+            ip = decodeIP(sessionID.substr(0, separator));
+            port = fromBase64(sessionID.substr(separator + 1));
+        }
+    }
 };
 
 class FileTransferClient {
     int sock;
-    struct sockaddr_in serv_addr;
+    struct sockaddr_storage serv_addr;
+    socklen_t serv_len = 0;
     std::string fileName;
+    int streams;
+    uint32_t chunkSize;
+    bool deltaMode = false;
+    bool compression = true;
+    bool verification = true;
+    int refetchRounds = 0;
+    uint64_t bytesOnWire = 0;
+    std::string lastError;
+    TransferStats stats;
+    std::atomic<bool> cancelled{false};
+    std::mutex socketsMutex;
+    std::vector<int> dataSockets;
 
 public:
-    FileTransferClient(const std::string& ip, int port, const std::string& fileName) : fileName(fileName) {
-        sock = socket(AF_INET, SOCK_STREAM, 0);
-        serv_addr.sin_family = AF_INET;
-        serv_addr.sin_port = htons(port);
-        inet_pton(AF_INET, ip.c_str(), &serv_addr.sin_addr);
+    FileTransferClient(const std::string& ip, int port, const std::string& fileName,
+                       int streams = TransferProtocol::kDefaultStreams,
+                       uint32_t chunkSize = TransferProtocol::kDefaultChunkSize)
+        : fileName(fileName), streams(streams), chunkSize(chunkSize) {
+        std::memset(&serv_addr, 0, sizeof(serv_addr));
+        if (!TransferProtocol::parseAddress(ip, port, serv_addr, serv_len)) {
+            serv_addr.ss_family = AF_INET;
+        }
+        sock = socket(serv_addr.ss_family, SOCK_STREAM, 0);
+        TransferIO::tuneSocket(sock);
     }
 
-    void connectToServer() {
-        if (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
-            perror("Connection Failed");
-            exit(EXIT_FAILURE);
+    FileTransferClient(const struct sockaddr_storage& address, socklen_t length, const std::string& fileName,
+                       int streams = TransferProtocol::kDefaultStreams,
+                       uint32_t chunkSize = TransferProtocol::kDefaultChunkSize)
+        : serv_addr(address), serv_len(length), fileName(fileName), streams(streams), chunkSize(chunkSize) {
+        sock = socket(serv_addr.ss_family, SOCK_STREAM, 0);
+        TransferIO::tuneSocket(sock);
+    }
+
+    bool connectToServer() {
+        if (connect(sock, (struct sockaddr *)&serv_addr, serv_len) < 0) {
+            return fail(std::string("Connection failed: ") + strerror(errno));
         }
+        return true;
+    }
+
+    void adoptSocket(int connected) {
+        close(sock);
+        sock = connected;
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) & ~O_NONBLOCK);
+        TransferIO::tuneSocket(sock);
     }
 
-    void sendFile() {
-        std::ifstream infile(fileName, std::ios::binary);
-        if (!infile) {
-            perror("File opening failed");
-            return;
+    void cancel() {
+        cancelled = true;
+        std::lock_guard<std::mutex> lock(socketsMutex);
+        shutdown(sock, SHUT_RDWR);
+        for (int dataSock : dataSockets) shutdown(dataSock, SHUT_RDWR);
+    }
+
+    bool sendFile() {
+        StatsScope scope(&stats);
+        if (std::filesystem::is_directory(fileName)) {
+            return sendDirectory();
+        }
+        int fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return fail(std::string("File opening failed: ") + strerror(errno));
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            std::string reason = strerror(errno);
+            close(fd);
+            return fail("File stat failed: " + reason);
+        }
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        TransferHeader header;
+        header.name = std::filesystem::path(fileName).filename().string();
+        header.size = static_cast<uint64_t>(st.st_size);
+        header.mtime = static_cast<uint64_t>(st.st_mtime);
+        header.chunkSize = chunkSize;
+        header.streams = static_cast<uint16_t>(std::max(1, streams));
+        header.transferId = TransferProtocol::newTransferId();
+        if (deltaMode) header.flags |= TransferProtocol::kFlagDelta;
+        if (compression) header.flags |= TransferProtocol::kFlagCompress;
+        if (verification) header.flags |= TransferProtocol::kFlagVerify;
+
+        WireReader reader(sock);
+        uint8_t status;
+        uint8_t mode = TransferProtocol::Chunked;
+        if (!header.write(sock) || !reader.getU8(status) ||
+            (status == TransferProtocol::Ok && deltaMode && !reader.getU8(mode))) {
+            close(fd);
+            return fail("Handshake failed");
+        }
+        if (status == TransferProtocol::Ok && mode == TransferProtocol::Delta) {
+            bool ok = sendDelta(fd, header, reader);
+            close(fd);
+            return ok;
         }
-        char buffer[1024];
-        while (infile.read(buffer, sizeof(buffer))) {
-            send(sock, buffer, infile.gcount(), 0);
+        uint8_t compressed = 0;
+        uint8_t verified = 0;
+        std::vector<uint8_t> bitmap;
+        if ((status == TransferProtocol::Ok && compression && !reader.getU8(compressed)) ||
+            (status == TransferProtocol::Ok && verification && !reader.getU8(verified))) {
+            close(fd);
+            return fail("Handshake failed");
         }
-        send(sock, buffer, infile.gcount(), 0);
-        infile.close();
+        if (status != TransferProtocol::Ok || !readBitmap(reader, header, bitmap)) {
+            close(fd);
+            return fail("Transfer rejected by receiver");
+        }
+
+        std::unique_ptr<ChunkVerifier> verifier;
+        if (verified) {
+            verifier = std::make_unique<ChunkVerifier>(fd, header);
+            verifier->addAll();
+            verifier->start();
+        }
+        std::vector<uint32_t> chunks = ChunkBitmap::missing(bitmap, header.chunkCount());
+        uint64_t pending = 0;
+        for (uint32_t chunk : chunks) pending += header.chunkLength(chunk);
+        stats.begin(pending);
+        bytesOnWire = 0;
+        bool digestsSent = false;
+        while (true) {
+            bool sent = sendRound(fd, header, chunks, compressed);
+            WireBuffer done;
+            done.putU8(sent ? TransferProtocol::Ok : TransferProtocol::Incomplete);
+            if (verifier && !digestsSent) {
+                if (!verifier->finish()) {
+                    close(fd);
+                    return fail("Failed to read the file for verification");
+                }
+                ChunkVerifier::writeDigests(done, verifier->getDigests(), header.size);
+                digestsSent = true;
+            }
+            if (!done.flush(sock) || !reader.getU8(status)) {
+                close(fd);
+                return fail("Receiver did not confirm the transfer");
+            }
+            if (status != TransferProtocol::Retry) break;
+            if (!readBitmap(reader, header, bitmap)) {
+                close(fd);
+                return fail("Receiver did not confirm the transfer");
+            }
+            chunks = ChunkBitmap::missing(bitmap, header.chunkCount());
+            ++refetchRounds;
+            for (uint32_t chunk : chunks) stats.expected += header.chunkLength(chunk);
+        }
+        verifier.reset();
+        close(fd);
+        if (status != TransferProtocol::Ok) {
+            return fail("Transfer incomplete, send again to resume");
+        }
+        return true;
     }
 
+    void setDeltaMode(bool enabled) { deltaMode = enabled; }
+
+    void setCompression(bool enabled) { compression = enabled; }
+
+    void setVerification(bool enabled) { verification = enabled; }
+
+    int getRefetchRounds() const { return refetchRounds; }
+
+    uint64_t getBytesOnWire() const { return bytesOnWire; }
+
+    const TransferStats& getStats() const { return stats; }
+
+    const std::string& getLastError() const { return lastError; }
+
     ~FileTransferClient() {
         close(sock);
     }
+
+private:
+    bool fail(const std::string& message) {
+        lastError = cancelled ? "Cancelled" : message;
+        return false;
+    }
+
+    bool trackSocket(int dataSock) {
+        std::lock_guard<std::mutex> lock(socketsMutex);
+        if (cancelled) return false;
+        dataSockets.push_back(dataSock);
+        return true;
+    }
+
+    void untrackSocket(int dataSock) {
+        std::lock_guard<std::mutex> lock(socketsMutex);
+        dataSockets.erase(std::remove(dataSockets.begin(), dataSockets.end(), dataSock), dataSockets.end());
+    }
+
+    static bool readBitmap(WireReader& reader, const TransferHeader& header, std::vector<uint8_t>& bitmap) {
+        uint32_t bitmapSize;
+        if (!reader.getU32(bitmapSize) || bitmapSize != (header.chunkCount() + 7) / 8) return false;
+        bitmap.resize(bitmapSize);
+        return reader.getBytes(bitmap.data(), bitmap.size());
+    }
+
+    bool sendRound(int fd, const TransferHeader& header, const std::vector<uint32_t>& chunks, bool compressed) {
+        size_t connections = std::min<size_t>(header.streams, chunks.size());
+        std::unique_ptr<ChunkPipeline> pipeline;
+        if (compressed) {
+            pipeline = std::make_unique<ChunkPipeline>(fd, header, chunks, connections);
+            pipeline->start();
+        }
+        std::atomic<size_t> cursor{0};
+        std::atomic<uint64_t> wire{0};
+        std::atomic<bool> failed{false};
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < connections; ++i) {
+            workers.emplace_back([&]() {
+                StatsScope workerScope(&stats);
+                if (!sendChunks(fd, header, chunks, cursor, pipeline.get(), wire)) failed = true;
+            });
+        }
+        for (auto& worker : workers) worker.join();
+        bytesOnWire += wire;
+        return !failed;
+    }
+
+    bool sendDirectory() {
+        TransferHeader header;
+        std::vector<TreeEntry> entries = TreeTransfer::scan(fileName, header.size);
+        header.name = std::filesystem::path(fileName).lexically_normal().filename().string();
+        if (header.name.empty()) header.name = std::filesystem::path(fileName).parent_path().filename().string();
+        header.flags = TransferProtocol::kFlagTree;
+        header.transferId = TransferProtocol::newTransferId();
+        bytesOnWire = header.size;
+        stats.begin(header.size);
+
+        WireReader reader(sock);
+        uint8_t status;
+        if (!header.write(sock) || !reader.getU8(status)) {
+            return fail("Handshake failed");
+        }
+        if (status != TransferProtocol::Ok) {
+            return fail("Transfer rejected by receiver");
+        }
+        TreeSender sender(fileName, std::move(entries));
+        if (!sender.send(sock) || !reader.getU8(status)) {
+            return fail("Directory transfer failed");
+        }
+        if (status != TransferProtocol::Ok) {
+            return fail("Receiver could not write every file");
+        }
+        return true;
+    }
+
+    bool sendDelta(int fd, const TransferHeader& header, WireReader& reader) {
+        uint32_t blockSize;
+        std::vector<BlockSignature> signatures;
+        if (!DeltaTransfer::readSignatures(reader, header.size, blockSize, signatures)) {
+            return fail("Failed to read block signatures");
+        }
+        stats.begin(header.size);
+        std::vector<DeltaOp> ops = DeltaTransfer::computeDelta(fd, header.size, blockSize, signatures);
+        bytesOnWire = 0;
+        for (const auto& op : ops) {
+            if (op.type == DeltaOp::Literal) bytesOnWire += op.length;
+        }
+
+        bool sent = DeltaTransfer::sendDelta(sock, fd, ops);
+        WireBuffer done;
+        done.putU8(sent ? TransferProtocol::Ok : TransferProtocol::Incomplete);
+        uint8_t status;
+        if (!sent || !done.flush(sock) || !reader.getU8(status)) {
+            return fail("Delta transfer failed");
+        }
+        if (status != TransferProtocol::Ok) {
+            return fail("Receiver could not rebuild the file, send again without delta");
+        }
+        return true;
+    }
+
+    bool sendChunks(int fd, const TransferHeader& header, const std::vector<uint32_t>& chunks, std::atomic<size_t>& cursor,
+                    ChunkPipeline* pipeline, std::atomic<uint64_t>& wire) {
+        int dataSock = socket(serv_addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (dataSock < 0) return false;
+        if (!trackSocket(dataSock)) {
+            close(dataSock);
+            return false;
+        }
+        TransferIO::tuneSocket(dataSock);
+        if (connect(dataSock, (struct sockaddr *)&serv_addr, serv_len) < 0) {
+            untrackSocket(dataSock);
+            close(dataSock);
+            return false;
+        }
+
+        WireBuffer frame;
+        frame.putU32(TransferProtocol::kMagic);
+        frame.putU8(TransferProtocol::Data);
+        frame.putU64(header.transferId);
+        bool ok = frame.flush(dataSock);
+
+        size_t i;
+        EncodedChunk chunk;
+        uint64_t streamSent = 0;
+        auto streamStart = std::chrono::steady_clock::now();
+        while (ok) {
+            if (pipeline) {
+                if (!pipeline->next(chunk)) break;
+            } else {
+                if ((i = cursor.fetch_add(1)) >= chunks.size()) break;
+                chunk.index = chunks[i];
+            }
+            uint32_t length = header.chunkLength(chunk.index);
+            frame.putU32(chunk.index);
+            frame.putU32(length);
+            if (pipeline) frame.putU8(chunk.codec);
+            if (chunk.codec == StreamCompression::Deflate) {
+                frame.putU32(static_cast<uint32_t>(chunk.payload.size()));
+                wire += chunk.payload.size();
+            } else {
+                wire += length;
+            }
+            if (!chunk.payload.empty()) {
+                frame.putBytes(chunk.payload.data(), chunk.payload.size());
+                ok = frame.flush(dataSock);
+            } else {
+                ok = frame.flush(dataSock) &&
+                     TransferIO::sendFileRange(dataSock, fd, static_cast<off_t>(chunk.index) * header.chunkSize, length);
+            }
+            if (pipeline) {
+                streamSent += chunk.codec == StreamCompression::Deflate ? chunk.payload.size() : length;
+                int queued = 0;
+                ioctl(dataSock, TIOCOUTQ, &queued);
+                pipeline->recordDrain(streamSent - std::min<uint64_t>(streamSent, queued),
+                                      std::chrono::steady_clock::now() - streamStart);
+            }
+            if (ok) TransferStats::reportProgress(length);
+        }
+        if (ok) {
+            frame.putU32(TransferProtocol::kEndOfChunks);
+            ok = frame.flush(dataSock);
+        }
+        untrackSocket(dataSock);
+        close(dataSock);
+        return ok;
+    }
 };
 
 class ClientUI {
@@ -118,6 +457,57 @@ public:
         return std::string(receivedID);
     }
 
+    enum PickResult { Picked, Manual, Cancelled };
+
+    PickResult pickPeer(PeerBrowser& browser, DiscoveredPeer& chosen) {
+        keypad(stdscr, TRUE);
+        timeout(500);
+        size_t selected = 0;
+        PickResult result = Cancelled;
+        while (true) {
+            std::vector<DiscoveredPeer> peers = browser.peers();
+            if (!peers.empty()) selected = std::min(selected, peers.size() - 1);
+            clear();
+            mvprintw(1, (COLS - 17) / 2, "Nearby receivers");
+            if (peers.empty()) mvprintw(3, (COLS - 22) / 2, "Searching the LAN ...");
+            for (size_t i = 0; i < peers.size() && 3 + i < static_cast<size_t>(LINES - 2); ++i) {
+                std::string row = peers[i].name + "  " + TransferProtocol::formatAddress(peers[i].candidates.front()) +
+                                  ":" + std::to_string(peers[i].port);
+                if (i == selected) attron(A_REVERSE);
+                mvprintw(3 + i, (COLS - row.size()) / 2, "%s", row.c_str());
+                if (i == selected) attroff(A_REVERSE);
+            }
+            mvprintw(LINES - 1, 0, "Enter: send  m: enter session ID  Esc: cancel");
+            refresh();
+            int ch = getch();
+            if (ch == KEY_UP && selected > 0) {
+                --selected;
+            } else if (ch == KEY_DOWN && selected + 1 < peers.size()) {
+                ++selected;
+            } else if ((ch == '\n' || ch == KEY_ENTER) && !peers.empty()) {
+                chosen = peers[selected];
+                result = Picked;
+                break;
+            } else if (ch == 'm' || ch == 'M') {
+                result = Manual;
+                break;
+            } else if (ch == 27) {
+                break;
+            }
+        }
+        timeout(-1);
+        clear();
+        refresh();
+        return result;
+    }
+
+    bool askYesNo(const std::string& question) {
+        mvprintw(4, (COLS - 34) / 2, "%s (y/n): ", question.c_str());
+        refresh();
+        int ch = getch();
+        return ch == 'y' || ch == 'Y';
+    }
+
     void showMessage(const std::string& message) {
         mvprintw(5, (COLS - message.size()) / 2, "%s", message.c_str());
         refresh();
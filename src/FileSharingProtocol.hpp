@@ -0,0 +1,337 @@
+#ifndef FILE_SHARING_PROTOCOL_HPP
+#define FILE_SHARING_PROTOCOL_HPP
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <endian.h>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <random>
+#include <algorithm>
+#include "TransferIO.hpp"
+
+class TransferProtocol {
+public:
+    static constexpr uint32_t kMagic = 0x53545831;
+    static constexpr uint32_t kEndOfChunks = 0xFFFFFFFF;
+    static constexpr uint32_t kDefaultChunkSize = 4 << 20;
+    static constexpr uint32_t kMaxChunkSize = 64 << 20;
+    static constexpr uint32_t kMaxChunks = 1 << 20;
+    static constexpr int kDefaultStreams = 4;
+    static constexpr int kAcceptTimeoutMs = 30000;
+    static constexpr uint32_t kFlagDelta = 1;
+    static constexpr uint32_t kFlagTree = 2;
+    static constexpr uint32_t kFlagCompress = 4;
+    static constexpr uint32_t kFlagVerify = 8;
+
+    enum ConnectionType : uint8_t {
+        Control = 1,
+        Data = 2,
+    };
+
+    enum Mode : uint8_t {
+        Chunked = 0,
+        Delta = 1,
+    };
+
+    enum Status : uint8_t {
+        Ok = 0,
+        Rejected = 1,
+        Incomplete = 2,
+        Retry = 3,
+    };
+
+    static uint64_t newTransferId() {
+        std::random_device device;
+        return (static_cast<uint64_t>(device()) << 32) | device();
+    }
+
+    static int acceptWithTimeout(int listenFd, int timeoutMs, int controlFd = -1) {
+        struct pollfd fds[2] = {{listenFd, POLLIN, 0}, {controlFd, POLLIN, 0}};
+        int ready;
+        do {
+            ready = poll(fds, controlFd >= 0 ? 2 : 1, timeoutMs);
+        } while (ready < 0 && errno == EINTR);
+        if (ready <= 0 || !(fds[0].revents & POLLIN)) return -1;
+        return accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+    }
+
+    static int listenDualStack(int port, int flags, int backlog) {
+        int fd = socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC | flags, 0);
+        if (fd >= 0) {
+            int off = 0;
+            setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+            struct sockaddr_in6 address{};
+            address.sin6_family = AF_INET6;
+            address.sin6_addr = in6addr_any;
+            address.sin6_port = htons(port);
+            if (bindAndListen(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address), backlog)) return fd;
+            close(fd);
+        }
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | flags, 0);
+        if (fd < 0) return -1;
+        struct sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = INADDR_ANY;
+        address.sin_port = htons(port);
+        if (bindAndListen(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address), backlog)) return fd;
+        close(fd);
+        return -1;
+    }
+
+    static int boundPort(int fd) {
+        struct sockaddr_storage bound;
+        socklen_t length = sizeof(bound);
+        if (getsockname(fd, reinterpret_cast<struct sockaddr*>(&bound), &length) != 0) return 0;
+        if (bound.ss_family == AF_INET6) return ntohs(reinterpret_cast<struct sockaddr_in6*>(&bound)->sin6_port);
+        return ntohs(reinterpret_cast<struct sockaddr_in*>(&bound)->sin_port);
+    }
+
+    static bool parseAddress(const std::string& host, int port, struct sockaddr_storage& address, socklen_t& length) {
+        struct addrinfo hints{};
+        hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo* result = nullptr;
+        if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0 || !result) return false;
+        std::memcpy(&address, result->ai_addr, result->ai_addrlen);
+        length = result->ai_addrlen;
+        freeaddrinfo(result);
+        return true;
+    }
+
+    static std::string formatAddress(const struct sockaddr_storage& address) {
+        char host[NI_MAXHOST];
+        socklen_t length = address.ss_family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+        if (getnameinfo(reinterpret_cast<const struct sockaddr*>(&address), length, host, sizeof(host), nullptr, 0,
+                        NI_NUMERICHOST) != 0) {
+            return "?";
+        }
+        return host;
+    }
+
+    static void setReceiveTimeout(int sock, int seconds) {
+        struct timeval tv{seconds, 0};
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+
+private:
+    static bool bindAndListen(int fd, const struct sockaddr* address, socklen_t length, int backlog) {
+        TransferIO::tuneSocket(fd);
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        return bind(fd, address, length) == 0 && listen(fd, backlog) == 0;
+    }
+};
+
+class WireBuffer {
+public:
+    void putU8(uint8_t value) { data.push_back(static_cast<char>(value)); }
+    void putU16(uint16_t value) { value = htobe16(value); append(&value, sizeof(value)); }
+    void putU32(uint32_t value) { value = htobe32(value); append(&value, sizeof(value)); }
+    void putU64(uint64_t value) { value = htobe64(value); append(&value, sizeof(value)); }
+    void putString(const std::string& value) {
+        size_t length = std::min<size_t>(value.size(), 0xFFFF);
+        putU16(static_cast<uint16_t>(length));
+        data.append(value, 0, length);
+    }
+    void putBytes(const void* bytes, size_t length) { append(bytes, length); }
+
+    bool flush(int fd) {
+        bool ok = TransferIO::writeAll(fd, data.data(), data.size());
+        data.clear();
+        return ok;
+    }
+
+    size_t size() const { return data.size(); }
+    const std::string& contents() const { return data; }
+
+private:
+    std::string data;
+
+    void append(const void* bytes, size_t length) {
+        data.append(static_cast<const char*>(bytes), length);
+    }
+};
+
+class WireReader {
+public:
+    WireReader(int fd) : fd(fd) {}
+
+    bool getU8(uint8_t& value) { return TransferIO::readAll(fd, &value, sizeof(value)); }
+    bool getU16(uint16_t& value) {
+        if (!TransferIO::readAll(fd, &value, sizeof(value))) return false;
+        value = be16toh(value);
+        return true;
+    }
+    bool getU32(uint32_t& value) {
+        if (!TransferIO::readAll(fd, &value, sizeof(value))) return false;
+        value = be32toh(value);
+        return true;
+    }
+    bool getU64(uint64_t& value) {
+        if (!TransferIO::readAll(fd, &value, sizeof(value))) return false;
+        value = be64toh(value);
+        return true;
+    }
+    bool getString(std::string& value) {
+        uint16_t length;
+        if (!getU16(length)) return false;
+        value.resize(length);
+        return length == 0 || TransferIO::readAll(fd, value.data(), length);
+    }
+    bool getBytes(void* bytes, size_t length) { return TransferIO::readAll(fd, bytes, length); }
+
+private:
+    int fd;
+};
+
+struct TransferHeader {
+    std::string name;
+    uint64_t size = 0;
+    uint64_t mtime = 0;
+    uint32_t chunkSize = TransferProtocol::kDefaultChunkSize;
+    uint16_t streams = 1;
+    uint32_t flags = 0;
+    uint64_t transferId = 0;
+
+    uint32_t chunkCount() const {
+        return static_cast<uint32_t>((size + chunkSize - 1) / chunkSize);
+    }
+
+    uint32_t chunkLength(uint32_t index) const {
+        uint64_t offset = static_cast<uint64_t>(index) * chunkSize;
+        return static_cast<uint32_t>(std::min<uint64_t>(chunkSize, size - offset));
+    }
+
+    bool withinLimits() const {
+        if (chunkSize == 0 || chunkSize > TransferProtocol::kMaxChunkSize) return false;
+        return (flags & TransferProtocol::kFlagTree) || size / chunkSize < TransferProtocol::kMaxChunks;
+    }
+
+    bool write(int fd) const {
+        WireBuffer buffer;
+        buffer.putU32(TransferProtocol::kMagic);
+        buffer.putU8(TransferProtocol::Control);
+        buffer.putString(name);
+        buffer.putU64(size);
+        buffer.putU64(mtime);
+        buffer.putU32(chunkSize);
+        buffer.putU16(streams);
+        buffer.putU32(flags);
+        buffer.putU64(transferId);
+        return buffer.flush(fd);
+    }
+
+    bool read(WireReader& reader) {
+        return reader.getString(name) && reader.getU64(size) && reader.getU64(mtime) &&
+               reader.getU32(chunkSize) && reader.getU16(streams) && reader.getU32(flags) &&
+               reader.getU64(transferId) && withinLimits();
+    }
+};
+
+class ChunkBitmap {
+public:
+    ~ChunkBitmap() {
+        if (fd >= 0) close(fd);
+    }
+
+    bool open(const std::string& resumePath, const TransferHeader& header) {
+        path = resumePath;
+        count = header.chunkCount();
+        bits.assign((count + 7) / 8, 0);
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) return false;
+
+        char stored[kHeaderSize];
+        char expected[kHeaderSize];
+        encodeHeader(header, expected);
+        bool resumed = pread(fd, stored, kHeaderSize, 0) == kHeaderSize &&
+                       std::memcmp(stored, expected, kHeaderSize) == 0 &&
+                       pread(fd, bits.data(), bits.size(), kHeaderSize) == static_cast<ssize_t>(bits.size());
+        if (!resumed) {
+            std::fill(bits.begin(), bits.end(), 0);
+            if (ftruncate(fd, 0) != 0 ||
+                !TransferIO::pwriteAll(fd, expected, kHeaderSize, 0) ||
+                !TransferIO::pwriteAll(fd, bits.data(), bits.size(), kHeaderSize)) {
+                return false;
+            }
+        }
+        fresh = !resumed;
+        return true;
+    }
+
+    bool isFresh() const { return fresh; }
+    uint32_t size() const { return count; }
+    const std::vector<uint8_t>& raw() const { return bits; }
+
+    bool test(uint32_t index) const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return (bits[index / 8] >> (index % 8)) & 1;
+    }
+
+    void mark(uint32_t index) {
+        std::lock_guard<std::mutex> lock(mtx);
+        bits[index / 8] |= static_cast<uint8_t>(1u << (index % 8));
+        if (fd >= 0) TransferIO::pwriteAll(fd, &bits[index / 8], 1, kHeaderSize + index / 8);
+    }
+
+    void clear(uint32_t index) {
+        std::lock_guard<std::mutex> lock(mtx);
+        bits[index / 8] &= static_cast<uint8_t>(~(1u << (index % 8)));
+        if (fd >= 0) TransferIO::pwriteAll(fd, &bits[index / 8], 1, kHeaderSize + index / 8);
+    }
+
+    bool complete() const {
+        for (uint32_t i = 0; i < count; ++i) {
+            if (!test(i)) return false;
+        }
+        return true;
+    }
+
+    void closeFile() {
+        if (fd >= 0) close(fd);
+        fd = -1;
+    }
+
+    void remove() {
+        closeFile();
+        unlink(path.c_str());
+    }
+
+    static std::vector<uint32_t> missing(const std::vector<uint8_t>& raw, uint32_t count) {
+        std::vector<uint32_t> chunks;
+        for (uint32_t i = 0; i < count; ++i) {
+            if (!((raw[i / 8] >> (i % 8)) & 1)) chunks.push_back(i);
+        }
+        return chunks;
+    }
+
+private:
+    static constexpr size_t kHeaderSize = 24;
+    std::string path;
+    std::vector<uint8_t> bits;
+    uint32_t count = 0;
+    int fd = -1;
+    bool fresh = true;
+    mutable std::mutex mtx;
+
+    static void encodeHeader(const TransferHeader& header, char* out) {
+        uint32_t magic = htobe32(0x53545253);
+        uint64_t size = htobe64(header.size);
+        uint64_t mtime = htobe64(header.mtime);
+        uint32_t chunkSize = htobe32(header.chunkSize);
+        std::memcpy(out, &magic, 4);
+        std::memcpy(out + 4, &size, 8);
+        std::memcpy(out + 12, &mtime, 8);
+        std::memcpy(out + 20, &chunkSize, 4);
+    }
+};
+#endif
@@ -10,6 +10,18 @@
 #include <sstream>
 #include <fstream>
 #include <ncurses.h>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <filesystem>
+#include <sys/stat.h>
+#include "FileSharingProtocol.hpp"
+#include "DeltaTransfer.hpp"
+#include "StreamCompression.hpp"
+#include "ChunkVerifier.hpp"
+#include "TreeTransfer.hpp"
+#include "ReceiveDaemon.hpp"
+#include "PeerDiscovery.hpp"
 
 class Base64Encoder {
 public:
@@ -51,6 +63,14 @@ public:
         }
         return output;
     }
+
+    static std::string encodeSession(const std::string& ip, int port) {
+        std::string output = encodeIP(ip);
+        if (port != 8080) {
+            output += "-" + toBase64(port);
+        }
+        return output;
+    }
 };
 
 const std::string Base64Encoder::base64_chars =
@@ -61,96 +81,335 @@ const std::string Base64Encoder::base64_chars =
 class NetworkUtils {
 public:
     static std::string getLocalIP() {
-        int sock = socket(AF_INET, SOCK_DGRAM, 0);
-        if (sock < 0) return "";
-        const char* kDummyAddress = "8.8.8.8";
-        int kDummyPort = 80;
-        struct sockaddr_in dummy_addr;
-        std::memset(&dummy_addr, 0, sizeof(dummy_addr));
-        dummy_addr.sin_family = AF_INET;
-        dummy_addr.sin_port = htons(kDummyPort);
-        inet_pton(AF_INET, kDummyAddress, &dummy_addr.sin_addr);
-        connect(sock, (struct sockaddr*)&dummy_addr, sizeof(dummy_addr));
-        struct sockaddr_in local_addr;
-        socklen_t addr_len = sizeof(local_addr);
-        getsockname(sock, (struct sockaddr*)&local_addr, &addr_len);
-        close(sock);
-        char local_ip[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &local_addr.sin_addr, local_ip, INET_ADDRSTRLEN);
-        return std::string(local_ip);
+        for (const auto& local : PeerDiscovery::localAddresses()) {
+            if (local.address.ss_family == AF_INET && !local.loopback) return TransferProtocol::formatAddress(local.address);
+        }
+        return "127.0.0.1";
+    }
+
+    static std::string hostName() {
+        char name[HOST_NAME_MAX + 1] = {};
+        if (gethostname(name, sizeof(name) - 1) != 0) return "receiver";
+        return name;
+    }
+
+    static int configuredPort() {
+        const char* port = getenv("SMART_TERMINAL_PORT");
+        return port ? atoi(port) : 0;
     }
 };
 
 class Server {
     int server_fd, new_socket;
-    struct sockaddr_in address;
-    int addrlen = sizeof(address);
 
 public:
-    Server(int port) {
-        server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    Server(int port) : new_socket(-1) {
+        server_fd = TransferProtocol::listenDualStack(port, 0, 16);
         if (server_fd < 0) {
-            perror("Socket creation failed");
-            exit(EXIT_FAILURE);
+            lastError = std::string("Bind failed: ") + strerror(errno);
         }
+    }
 
-        int opt = 1;
-        if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-            perror("Set socket options failed");
-            close(server_fd);
-            exit(EXIT_FAILURE);
+    bool isListening() const { return server_fd >= 0; }
+
+    int getListenFd() const { return server_fd; }
+
+    bool acceptConnection(int timeoutMs = -1) {
+        if (server_fd < 0) return false;
+        errno = 0;
+        new_socket = TransferProtocol::acceptWithTimeout(server_fd, timeoutMs);
+        if (new_socket < 0) {
+            return fail(errno ? std::string("Accept failed: ") + strerror(errno) : "No sender connected");
         }
+        stats.begin(0);
+        return true;
+    }
 
-        address.sin_family = AF_INET;
-        address.sin_addr.s_addr = INADDR_ANY;
-        address.sin_port = htons(port);
+    void cancel() {
+        cancelled = true;
+        std::lock_guard<std::mutex> lock(socketsMutex);
+        if (server_fd >= 0) shutdown(server_fd, SHUT_RDWR);
+        if (new_socket >= 0) shutdown(new_socket, SHUT_RDWR);
+        for (int dataSock : dataSockets) shutdown(dataSock, SHUT_RDWR);
+    }
 
-        if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
-            perror("Bind failed");
-            close(server_fd);
-            exit(EXIT_FAILURE);
+    bool receiveFile(const std::string &filePath) {
+        StatsScope scope(&stats);
+        WireReader reader(new_socket);
+        uint32_t magic;
+        uint8_t type;
+        TransferHeader header;
+        if (!reader.getU32(magic) || !reader.getU8(type) || magic != TransferProtocol::kMagic ||
+            type != TransferProtocol::Control || !header.read(reader)) {
+            return fail("Invalid transfer header");
         }
 
-        if (listen(server_fd, 3) < 0) {
-            perror("Listen failed");
-            close(server_fd);
-            exit(EXIT_FAILURE);
+        std::string target = filePath;
+        if (target.empty() || target.back() == '/' || std::filesystem::is_directory(target)) {
+            std::string name = std::filesystem::path(header.name).filename().string();
+            if (name.empty() || name == "." || name == "..") name = "received.bin";
+            target = (std::filesystem::path(target) / name).string();
         }
-    }
+        receivedPath = target;
 
-    void acceptConnection() {
-        new_socket = accept(server_fd, (struct sockaddr *)&address, (socklen_t*)&addrlen);
-        if (new_socket < 0) {
-            perror("Accept failed");
-            close(server_fd);
-            exit(EXIT_FAILURE);
+        stats.begin(header.size);
+        if (header.flags & TransferProtocol::kFlagTree) {
+            return receiveTree(target);
         }
-    }
 
-    void receiveFile(const std::string &filePath) {
-        std::ofstream outfile(filePath, std::ios::binary);
-        if (!outfile) {
-            perror("File opening failed");
-            return;
+        bool deltaRequested = (header.flags & TransferProtocol::kFlagDelta) != 0;
+        if (deltaRequested && canUseDelta(target)) {
+            return receiveDelta(target, header, reader);
         }
 
-        char buffer[1024];
-        int bytesRead;
-        while ((bytesRead = read(new_socket, buffer, sizeof(buffer))) > 0) {
-            outfile.write(buffer, bytesRead);
+        ChunkBitmap bitmap;
+        int fd = open(target.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0 || !bitmap.open(target + ".resume", header)) {
+            if (fd >= 0) close(fd);
+            WireBuffer reject;
+            reject.putU8(TransferProtocol::Rejected);
+            reject.putU32(0);
+            reject.flush(new_socket);
+            return fail(std::string("File opening failed: ") + strerror(errno));
+        }
+        if (bitmap.isFresh()) {
+            ftruncate(fd, 0);
+            TransferIO::preallocate(fd, header.size);
+        }
+
+        bool compressed = (header.flags & TransferProtocol::kFlagCompress) != 0;
+        bool verify = (header.flags & TransferProtocol::kFlagVerify) != 0;
+        WireBuffer reply;
+        reply.putU8(TransferProtocol::Ok);
+        if (deltaRequested) reply.putU8(TransferProtocol::Chunked);
+        if (compressed) reply.putU8(1);
+        if (verify) reply.putU8(1);
+        reply.putU32(static_cast<uint32_t>(bitmap.raw().size()));
+        reply.putBytes(bitmap.raw().data(), bitmap.raw().size());
+        if (!reply.flush(new_socket)) {
+            close(fd);
+            return fail("Sender disconnected");
         }
 
-        if (bytesRead < 0) {
-            perror("Read error");
+        std::unique_ptr<ChunkVerifier> verifier;
+        if (verify) {
+            verifier = std::make_unique<ChunkVerifier>(fd, header);
+            verifier->addPresent(bitmap);
+            verifier->start();
         }
+        std::vector<ChunkDigest> expected;
+        bool complete = false;
+        for (int round = 1; ; ++round) {
+            receiveRound(fd, header, bitmap, compressed, verifier.get(), round == 1);
+            uint8_t senderStatus = TransferProtocol::Incomplete;
+            if (!reader.getU8(senderStatus)) {
+                complete = !verify && bitmap.complete();
+                break;
+            }
+            if (verifier) {
+                if (round == 1 && !ChunkVerifier::readDigests(reader, header.chunkCount(), header.size, expected)) break;
+                verifier->finish();
+                std::vector<uint32_t> bad = verifier->mismatches(expected, bitmap);
+                for (uint32_t chunk : bad) bitmap.clear(chunk);
+                corruptChunks += bad.size();
+            }
+            complete = bitmap.complete();
+            if (complete || !verify || round == ChunkVerifier::kMaxRounds) break;
+            WireBuffer retry;
+            retry.putU8(TransferProtocol::Retry);
+            retry.putU32(static_cast<uint32_t>(bitmap.raw().size()));
+            retry.putBytes(bitmap.raw().data(), bitmap.raw().size());
+            if (!retry.flush(new_socket)) break;
+        }
+        verifier.reset();
+        if (complete) {
+            ftruncate(fd, static_cast<off_t>(header.size));
+            bitmap.remove();
+        }
+        close(fd);
+
+        WireBuffer done;
+        done.putU8(complete ? TransferProtocol::Ok : TransferProtocol::Incomplete);
+        done.flush(new_socket);
+        return complete ? true : fail("Transfer interrupted, partial data kept for resume");
+    }
 
-        outfile.close();
+    uint64_t getCorruptChunks() const { return corruptChunks; }
+
+    const std::string& getLastError() const { return lastError; }
+    const std::string& getReceivedPath() const { return receivedPath; }
+
+    const TransferStats& getStats() const { return stats; }
+
+    int getPort() const {
+        return TransferProtocol::boundPort(server_fd);
     }
 
     ~Server() {
         close(new_socket);
         close(server_fd);
     }
+
+private:
+    std::string lastError;
+    std::string receivedPath;
+    TransferStats stats;
+    uint64_t corruptChunks = 0;
+    std::atomic<bool> cancelled{false};
+    std::mutex socketsMutex;
+    std::vector<int> dataSockets;
+
+    bool fail(const std::string& message) {
+        lastError = cancelled ? "Cancelled" : message;
+        return false;
+    }
+
+    bool trackSocket(int sock) {
+        std::lock_guard<std::mutex> lock(socketsMutex);
+        if (cancelled) return false;
+        dataSockets.push_back(sock);
+        return true;
+    }
+
+    void untrackSocket(int sock) {
+        std::lock_guard<std::mutex> lock(socketsMutex);
+        dataSockets.erase(std::remove(dataSockets.begin(), dataSockets.end(), sock), dataSockets.end());
+    }
+
+    void receiveRound(int fd, const TransferHeader& header, ChunkBitmap& bitmap, bool compressed, ChunkVerifier* verifier,
+                      bool first) {
+        std::vector<uint32_t> missing = ChunkBitmap::missing(bitmap.raw(), bitmap.size());
+        uint64_t pending = 0;
+        for (uint32_t chunk : missing) pending += header.chunkLength(chunk);
+        if (first) {
+            stats.begin(pending);
+        } else {
+            stats.expected += pending;
+        }
+        size_t connections = std::min<size_t>(header.streams, missing.size());
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < connections; ++i) {
+            int dataSock = TransferProtocol::acceptWithTimeout(server_fd, TransferProtocol::kAcceptTimeoutMs, new_socket);
+            if (dataSock < 0) break;
+            if (!trackSocket(dataSock)) {
+                close(dataSock);
+                break;
+            }
+            workers.emplace_back([this, dataSock, fd, compressed, verifier, &header, &bitmap]() {
+                StatsScope workerScope(&stats);
+                receiveChunks(dataSock, fd, header, bitmap, compressed, verifier);
+                untrackSocket(dataSock);
+                close(dataSock);
+            });
+        }
+        for (auto& worker : workers) worker.join();
+    }
+
+    bool receiveTree(const std::string& target) {
+        WireBuffer reply;
+        reply.putU8(TransferProtocol::Ok);
+        if (!reply.flush(new_socket)) {
+            return fail("Sender disconnected");
+        }
+        uint64_t files = 0;
+        TreeReceiver receiver(target);
+        bool complete = receiver.receive(new_socket, files);
+
+        WireBuffer done;
+        done.putU8(complete ? TransferProtocol::Ok : TransferProtocol::Incomplete);
+        done.flush(new_socket);
+        return complete ? true : fail("Directory transfer incomplete after " + std::to_string(files) + " files");
+    }
+
+    bool canUseDelta(const std::string& target) {
+        struct stat st;
+        return stat(target.c_str(), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+               access((target + ".resume").c_str(), F_OK) != 0;
+    }
+
+    bool receiveDelta(const std::string& target, const TransferHeader& header, WireReader& reader) {
+        int basisFd = open(target.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (basisFd < 0 || fstat(basisFd, &st) != 0) {
+            if (basisFd >= 0) close(basisFd);
+            return fail("Failed to open existing file for delta");
+        }
+        uint64_t basisSize = static_cast<uint64_t>(st.st_size);
+        uint32_t blockSize = DeltaTransfer::chooseBlockSize(basisSize);
+        std::vector<BlockSignature> signatures = DeltaTransfer::computeSignatures(basisFd, basisSize, blockSize);
+        signatures.resize(std::min<uint64_t>(signatures.size(), DeltaTransfer::maxSignatures(header.size, blockSize)));
+
+        WireBuffer reply;
+        reply.putU8(TransferProtocol::Ok);
+        reply.putU8(TransferProtocol::Delta);
+        std::string tempPath = target + ".delta";
+        int outFd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 0777);
+        if (outFd < 0 || !reply.flush(new_socket) || !DeltaTransfer::sendSignatures(new_socket, blockSize, signatures)) {
+            if (outFd >= 0) close(outFd);
+            close(basisFd);
+            unlink(tempPath.c_str());
+            return fail("Sender disconnected");
+        }
+        TransferIO::preallocate(outFd, header.size);
+
+        uint64_t written = 0;
+        bool applied = DeltaTransfer::applyDelta(reader, new_socket, basisFd, blockSize,
+                                                 static_cast<uint32_t>(signatures.size()), outFd, written);
+        uint8_t senderStatus = TransferProtocol::Incomplete;
+        if (applied) reader.getU8(senderStatus);
+        bool complete = applied && senderStatus == TransferProtocol::Ok && written == header.size &&
+                        ftruncate(outFd, static_cast<off_t>(written)) == 0;
+        close(outFd);
+        close(basisFd);
+        if (complete) {
+            complete = rename(tempPath.c_str(), target.c_str()) == 0;
+        }
+        if (!complete) {
+            unlink(tempPath.c_str());
+        }
+
+        WireBuffer done;
+        done.putU8(complete ? TransferProtocol::Ok : TransferProtocol::Incomplete);
+        done.flush(new_socket);
+        return complete ? true : fail("Delta transfer failed, existing file left unchanged");
+    }
+
+    void receiveChunks(int dataSock, int fd, const TransferHeader& header, ChunkBitmap& bitmap, bool compressed,
+                       ChunkVerifier* verifier) {
+        TransferProtocol::setReceiveTimeout(dataSock, 60);
+        WireReader reader(dataSock);
+        uint32_t magic;
+        uint8_t type;
+        uint64_t transferId;
+        if (!reader.getU32(magic) || !reader.getU8(type) || !reader.getU64(transferId) ||
+            magic != TransferProtocol::kMagic || type != TransferProtocol::Data || transferId != header.transferId) {
+            return;
+        }
+
+        uint32_t index, length, packedLength;
+        uint8_t codec = StreamCompression::Stored;
+        std::string packed, raw;
+        while (reader.getU32(index) && index != TransferProtocol::kEndOfChunks && reader.getU32(length)) {
+            if (index >= header.chunkCount() || length != header.chunkLength(index)) return;
+            if (compressed && !reader.getU8(codec)) return;
+            off_t offset = static_cast<off_t>(index) * header.chunkSize;
+            if (codec == StreamCompression::Deflate) {
+                if (!reader.getU32(packedLength) || packedLength > length) return;
+                packed.resize(packedLength);
+                if (!reader.getBytes(packed.data(), packedLength) ||
+                    !StreamCompression::decompress(packed, length, raw) ||
+                    !TransferIO::pwriteAll(fd, raw.data(), length, offset)) {
+                    return;
+                }
+            } else if (codec != StreamCompression::Stored ||
+                       TransferIO::receiveToFile(dataSock, fd, offset, length) != length) {
+                return;
+            }
+            bitmap.mark(index);
+            if (verifier) verifier->add(index);
+            TransferStats::reportProgress(length);
+        }
+    }
 };
 
 class ServerUI {
@@ -168,6 +427,7 @@ public:
     }
 
     std::string getFilename() {
+        mvprintw(2, (COLS - 40) / 2, "(Leave empty to keep the sender's name)");
         mvprintw(3, (COLS - 34) / 2, "Enter filename to receive: ");
         refresh();
         echo();
@@ -187,6 +447,27 @@ public:
         refresh();
     }
 
+    void showMessage(const std::string& message) {
+        mvprintw(7, (COLS - message.size()) / 2, "%s", message.c_str());
+        refresh();
+    }
+
+    void showTransferTable(const std::string& sessionID, const std::vector<TransferRow>& rows) {
+        erase();
+        mvprintw(0, 0, "Receive daemon | Session ID: %s | q to stop", sessionID.c_str());
+        mvprintw(2, 0, "%-24s %10s %7s %8s %4s %8s %7s %6s %6s  %s", "Name", "Size", "Done", "MiB/s", "Conn",
+                 "Calls", "Avg KiB", "Sock s", "Disk s", "State");
+        int row = 3;
+        for (auto it = rows.rbegin(); it != rows.rend() && row < LINES; ++it, ++row) {
+            double percent = it->size > 0 ? 100.0 * it->received / it->size : 100.0;
+            mvprintw(row, 0, "%-24.24s %9.1fM %6.1f%% %8.1f %4d %8lu %7.1f %6.2f %6.2f  %s", it->name.c_str(),
+                     it->size / 1048576.0, percent, it->rate / 1048576.0, it->connections,
+                     static_cast<unsigned long>(it->socketCalls), it->averageRead / 1024.0, it->socketSeconds,
+                     it->diskSeconds, it->state.c_str());
+        }
+        refresh();
+    }
+
     void waitForExit() {
         getch();
     }
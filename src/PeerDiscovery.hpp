@@ -0,0 +1,480 @@
+#ifndef PEER_DISCOVERY_HPP
+#define PEER_DISCOVERY_HPP
+
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "FileSharingProtocol.hpp"
+
+struct LocalAddress {
+    std::string interface;
+    unsigned index;
+    struct sockaddr_storage address;
+    struct sockaddr_storage broadcast;
+    bool hasBroadcast;
+    bool multicast;
+    bool loopback;
+};
+
+struct DiscoveredPeer {
+    uint64_t id;
+    std::string name;
+    uint16_t port;
+    uint16_t probePort;
+    std::vector<struct sockaddr_storage> candidates;
+    std::chrono::steady_clock::time_point lastSeen;
+};
+
+class PeerDiscovery {
+public:
+    static constexpr uint16_t kDiscoveryPort = 45454;
+    static constexpr uint32_t kMagic = 0x53544431;
+    static constexpr uint8_t kAnnounce = 1;
+    static constexpr uint8_t kProbe = 2;
+    static constexpr const char* kGroup4 = "239.255.83.84";
+    static constexpr const char* kGroup6 = "ff02::114";
+    static constexpr int kStaleSeconds = 5;
+
+    static std::vector<LocalAddress> localAddresses() {
+        std::vector<LocalAddress> addresses;
+        struct ifaddrs* list = nullptr;
+        if (getifaddrs(&list) != 0) return addresses;
+        for (struct ifaddrs* it = list; it; it = it->ifa_next) {
+            if (!it->ifa_addr || !(it->ifa_flags & IFF_UP)) continue;
+            int family = it->ifa_addr->sa_family;
+            if (family != AF_INET && family != AF_INET6) continue;
+            LocalAddress entry{};
+            entry.interface = it->ifa_name;
+            entry.index = if_nametoindex(it->ifa_name);
+            std::memcpy(&entry.address, it->ifa_addr, family == AF_INET ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6));
+            entry.multicast = (it->ifa_flags & IFF_MULTICAST) != 0;
+            entry.loopback = (it->ifa_flags & IFF_LOOPBACK) != 0;
+            entry.hasBroadcast = family == AF_INET && (it->ifa_flags & IFF_BROADCAST) && it->ifa_broadaddr;
+            if (entry.hasBroadcast) std::memcpy(&entry.broadcast, it->ifa_broadaddr, sizeof(struct sockaddr_in));
+            addresses.push_back(entry);
+        }
+        freeifaddrs(list);
+        return addresses;
+    }
+
+    static bool isLinkLocal(const struct sockaddr_storage& address) {
+        if (address.ss_family != AF_INET6) return false;
+        return IN6_IS_ADDR_LINKLOCAL(&reinterpret_cast<const struct sockaddr_in6*>(&address)->sin6_addr);
+    }
+
+    static void setPort(struct sockaddr_storage& address, uint16_t port) {
+        if (address.ss_family == AF_INET6) {
+            reinterpret_cast<struct sockaddr_in6*>(&address)->sin6_port = htons(port);
+        } else {
+            reinterpret_cast<struct sockaddr_in*>(&address)->sin_port = htons(port);
+        }
+    }
+
+    static socklen_t lengthOf(const struct sockaddr_storage& address) {
+        return address.ss_family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+    }
+
+    static bool sameHost(const struct sockaddr_storage& a, const struct sockaddr_storage& b) {
+        if (a.ss_family != b.ss_family) return false;
+        if (a.ss_family == AF_INET) {
+            return reinterpret_cast<const struct sockaddr_in*>(&a)->sin_addr.s_addr ==
+                   reinterpret_cast<const struct sockaddr_in*>(&b)->sin_addr.s_addr;
+        }
+        const auto* a6 = reinterpret_cast<const struct sockaddr_in6*>(&a);
+        const auto* b6 = reinterpret_cast<const struct sockaddr_in6*>(&b);
+        return std::memcmp(&a6->sin6_addr, &b6->sin6_addr, sizeof(a6->sin6_addr)) == 0 &&
+               a6->sin6_scope_id == b6->sin6_scope_id;
+    }
+
+    static bool fastestPath(const DiscoveredPeer& peer, struct sockaddr_storage& best, socklen_t& length, int timeoutMs = 500) {
+        if (peer.candidates.empty()) return false;
+        best = peer.candidates.front();
+        int sockets[2] = {socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0), socket(AF_INET6, SOCK_DGRAM | SOCK_CLOEXEC, 0)};
+        uint64_t nonce = std::random_device{}();
+        for (size_t i = 0; i < peer.candidates.size(); ++i) {
+            struct sockaddr_storage target = peer.candidates[i];
+            setPort(target, peer.probePort);
+            WireBuffer probe;
+            probe.putU32(kMagic);
+            probe.putU8(kProbe);
+            probe.putU64(nonce);
+            probe.putU32(static_cast<uint32_t>(i));
+            int sock = sockets[target.ss_family == AF_INET6 ? 1 : 0];
+            if (sock >= 0) {
+                sendto(sock, probe.contents().data(), probe.size(), 0, reinterpret_cast<struct sockaddr*>(&target), lengthOf(target));
+            }
+        }
+
+        bool found = false;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        while (!found) {
+            int remaining = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count());
+            if (remaining <= 0) break;
+            struct pollfd fds[2] = {{sockets[0], POLLIN, 0}, {sockets[1], POLLIN, 0}};
+            if (poll(fds, 2, remaining) <= 0) break;
+            for (int f = 0; f < 2 && !found; ++f) {
+                if (!(fds[f].revents & POLLIN)) continue;
+                char reply[64];
+                ssize_t got = recv(sockets[f], reply, sizeof(reply), 0);
+                uint32_t magic, index;
+                uint64_t echoed;
+                if (got != 17) continue;
+                std::memcpy(&magic, reply, 4);
+                std::memcpy(&echoed, reply + 5, 8);
+                std::memcpy(&index, reply + 13, 4);
+                index = be32toh(index);
+                if (be32toh(magic) == kMagic && static_cast<uint8_t>(reply[4]) == kProbe && be64toh(echoed) == nonce &&
+                    index < peer.candidates.size()) {
+                    best = peer.candidates[index];
+                    found = true;
+                }
+            }
+        }
+        for (int sock : sockets) {
+            if (sock >= 0) close(sock);
+        }
+        setPort(best, peer.port);
+        length = lengthOf(best);
+        return true;
+    }
+};
+
+class PeerAnnouncer {
+public:
+    PeerAnnouncer(uint16_t port, const std::string& name) : port(port), name(name) {
+        std::random_device device;
+        id = (static_cast<uint64_t>(device()) << 32) | device();
+    }
+
+    ~PeerAnnouncer() {
+        stop();
+    }
+
+    void start() {
+        probeSocket = socket(AF_INET6, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (probeSocket >= 0) {
+            int off = 0;
+            setsockopt(probeSocket, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+            struct sockaddr_in6 address{};
+            address.sin6_family = AF_INET6;
+            address.sin6_addr = in6addr_any;
+            address.sin6_port = htons(port);
+            if (bind(probeSocket, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) {
+                address.sin6_port = 0;
+                bind(probeSocket, reinterpret_cast<struct sockaddr*>(&address), sizeof(address));
+            }
+        }
+        probePort = probeSocket >= 0 ? static_cast<uint16_t>(TransferProtocol::boundPort(probeSocket)) : 0;
+        running = true;
+        worker = std::thread(&PeerAnnouncer::loop, this);
+    }
+
+    void stop() {
+        if (running.exchange(false)) worker.join();
+        if (probeSocket >= 0) close(probeSocket);
+        probeSocket = -1;
+    }
+
+private:
+    uint16_t port;
+    uint16_t probePort = 0;
+    std::string name;
+    uint64_t id;
+    int probeSocket = -1;
+    std::atomic<bool> running{false};
+    std::thread worker;
+
+    std::string announcement(const std::vector<LocalAddress>& addresses) {
+        WireBuffer packet;
+        packet.putU32(PeerDiscovery::kMagic);
+        packet.putU8(PeerDiscovery::kAnnounce);
+        packet.putU64(id);
+        packet.putU16(port);
+        packet.putU16(probePort);
+        packet.putString(name);
+        std::vector<std::string> listed;
+        for (const auto& local : addresses) {
+            if (local.loopback || PeerDiscovery::isLinkLocal(local.address)) continue;
+            listed.push_back(TransferProtocol::formatAddress(local.address));
+        }
+        packet.putU8(static_cast<uint8_t>(std::min<size_t>(listed.size(), 32)));
+        for (size_t i = 0; i < listed.size() && i < 32; ++i) packet.putString(listed[i]);
+        return packet.contents();
+    }
+
+    void announce() {
+        std::vector<LocalAddress> addresses = PeerDiscovery::localAddresses();
+        std::string packet = announcement(addresses);
+        int sock4 = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        int sock6 = socket(AF_INET6, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        int on = 1;
+        if (sock4 >= 0) {
+            setsockopt(sock4, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+            setsockopt(sock4, IPPROTO_IP, IP_MULTICAST_LOOP, &on, sizeof(on));
+        }
+        if (sock6 >= 0) setsockopt(sock6, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, &on, sizeof(on));
+
+        struct sockaddr_in group4{};
+        group4.sin_family = AF_INET;
+        group4.sin_port = htons(PeerDiscovery::kDiscoveryPort);
+        inet_pton(AF_INET, PeerDiscovery::kGroup4, &group4.sin_addr);
+        struct sockaddr_in6 group6{};
+        group6.sin6_family = AF_INET6;
+        group6.sin6_port = htons(PeerDiscovery::kDiscoveryPort);
+        inet_pton(AF_INET6, PeerDiscovery::kGroup6, &group6.sin6_addr);
+
+        std::vector<unsigned> announced6;
+        for (const auto& local : addresses) {
+            if (local.address.ss_family == AF_INET && sock4 >= 0) {
+                if (local.loopback) {
+                    struct sockaddr_in target = group4;
+                    target.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                    sendto(sock4, packet.data(), packet.size(), 0, reinterpret_cast<struct sockaddr*>(&target), sizeof(target));
+                    continue;
+                }
+                if (local.multicast) {
+                    struct in_addr interface = reinterpret_cast<const struct sockaddr_in*>(&local.address)->sin_addr;
+                    setsockopt(sock4, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface));
+                    sendto(sock4, packet.data(), packet.size(), 0, reinterpret_cast<struct sockaddr*>(&group4), sizeof(group4));
+                }
+                if (local.hasBroadcast) {
+                    struct sockaddr_in target;
+                    std::memcpy(&target, &local.broadcast, sizeof(target));
+                    target.sin_port = htons(PeerDiscovery::kDiscoveryPort);
+                    sendto(sock4, packet.data(), packet.size(), 0, reinterpret_cast<struct sockaddr*>(&target), sizeof(target));
+                }
+            } else if (local.address.ss_family == AF_INET6 && sock6 >= 0) {
+                if (local.loopback) {
+                    struct sockaddr_in6 target = group6;
+                    target.sin6_addr = in6addr_loopback;
+                    sendto(sock6, packet.data(), packet.size(), 0, reinterpret_cast<struct sockaddr*>(&target), sizeof(target));
+                    continue;
+                }
+                if (!local.multicast || std::find(announced6.begin(), announced6.end(), local.index) != announced6.end()) continue;
+                announced6.push_back(local.index);
+                unsigned index = local.index;
+                setsockopt(sock6, IPPROTO_IPV6, IPV6_MULTICAST_IF, &index, sizeof(index));
+                struct sockaddr_in6 target = group6;
+                target.sin6_scope_id = index;
+                sendto(sock6, packet.data(), packet.size(), 0, reinterpret_cast<struct sockaddr*>(&target), sizeof(target));
+            }
+        }
+        if (sock4 >= 0) close(sock4);
+        if (sock6 >= 0) close(sock6);
+    }
+
+    void loop() {
+        auto nextAnnounce = std::chrono::steady_clock::now();
+        while (running) {
+            auto now = std::chrono::steady_clock::now();
+            if (now >= nextAnnounce) {
+                announce();
+                nextAnnounce = now + std::chrono::seconds(1);
+            }
+            struct pollfd pfd{probeSocket, POLLIN, 0};
+            if (probeSocket < 0 || poll(&pfd, 1, 200) <= 0) {
+                if (probeSocket < 0) std::this_thread::sleep_for(std::chrono::milliseconds(200));
+                continue;
+            }
+            char probe[64];
+            struct sockaddr_storage from;
+            socklen_t fromLength = sizeof(from);
+            ssize_t got = recvfrom(probeSocket, probe, sizeof(probe), 0, reinterpret_cast<struct sockaddr*>(&from), &fromLength);
+            uint32_t magic;
+            if (got != 17) continue;
+            std::memcpy(&magic, probe, 4);
+            if (be32toh(magic) != PeerDiscovery::kMagic || static_cast<uint8_t>(probe[4]) != PeerDiscovery::kProbe) continue;
+            sendto(probeSocket, probe, static_cast<size_t>(got), 0, reinterpret_cast<struct sockaddr*>(&from), fromLength);
+        }
+    }
+};
+
+class PeerBrowser {
+public:
+    ~PeerBrowser() {
+        stop();
+    }
+
+    bool start() {
+        socket4 = openSocket(AF_INET);
+        socket6 = openSocket(AF_INET6);
+        if (socket4 < 0 && socket6 < 0) return false;
+        joinGroups();
+        running = true;
+        worker = std::thread(&PeerBrowser::loop, this);
+        return true;
+    }
+
+    void stop() {
+        if (running.exchange(false)) worker.join();
+        if (socket4 >= 0) close(socket4);
+        if (socket6 >= 0) close(socket6);
+        socket4 = socket6 = -1;
+    }
+
+    std::vector<DiscoveredPeer> peers() {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto cutoff = std::chrono::steady_clock::now() - std::chrono::seconds(PeerDiscovery::kStaleSeconds);
+        found.erase(std::remove_if(found.begin(), found.end(), [&](const DiscoveredPeer& peer) {
+            return peer.lastSeen < cutoff;
+        }), found.end());
+        return found;
+    }
+
+private:
+    int socket4 = -1;
+    int socket6 = -1;
+    std::atomic<bool> running{false};
+    std::thread worker;
+    std::mutex mtx;
+    std::vector<DiscoveredPeer> found;
+
+    static int openSocket(int family) {
+        int sock = socket(family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (sock < 0) return -1;
+        int on = 1;
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+        int bound;
+        if (family == AF_INET) {
+            struct sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = INADDR_ANY;
+            address.sin_port = htons(PeerDiscovery::kDiscoveryPort);
+            bound = bind(sock, reinterpret_cast<struct sockaddr*>(&address), sizeof(address));
+        } else {
+            setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on));
+            struct sockaddr_in6 address{};
+            address.sin6_family = AF_INET6;
+            address.sin6_addr = in6addr_any;
+            address.sin6_port = htons(PeerDiscovery::kDiscoveryPort);
+            bound = bind(sock, reinterpret_cast<struct sockaddr*>(&address), sizeof(address));
+        }
+        if (bound != 0) {
+            close(sock);
+            return -1;
+        }
+        return sock;
+    }
+
+    void joinGroups() {
+        std::vector<unsigned> joined6;
+        for (const auto& local : PeerDiscovery::localAddresses()) {
+            if (!local.multicast) continue;
+            if (local.address.ss_family == AF_INET && socket4 >= 0) {
+                struct ip_mreq request{};
+                inet_pton(AF_INET, PeerDiscovery::kGroup4, &request.imr_multiaddr);
+                request.imr_interface = reinterpret_cast<const struct sockaddr_in*>(&local.address)->sin_addr;
+                setsockopt(socket4, IPPROTO_IP, IP_ADD_MEMBERSHIP, &request, sizeof(request));
+            } else if (local.address.ss_family == AF_INET6 && socket6 >= 0 &&
+                       std::find(joined6.begin(), joined6.end(), local.index) == joined6.end()) {
+                joined6.push_back(local.index);
+                struct ipv6_mreq request{};
+                inet_pton(AF_INET6, PeerDiscovery::kGroup6, &request.ipv6mr_multiaddr);
+                request.ipv6mr_interface = local.index;
+                setsockopt(socket6, IPPROTO_IPV6, IPV6_JOIN_GROUP, &request, sizeof(request));
+            }
+        }
+    }
+
+    void loop() {
+        while (running) {
+            struct pollfd fds[2] = {{socket4, POLLIN, 0}, {socket6, POLLIN, 0}};
+            if (poll(fds, 2, 200) <= 0) continue;
+            for (const auto& pfd : fds) {
+                if (pfd.fd >= 0 && (pfd.revents & POLLIN)) receive(pfd.fd);
+            }
+        }
+    }
+
+    void receive(int sock) {
+        char packet[2048];
+        struct sockaddr_storage from{};
+        socklen_t fromLength = sizeof(from);
+        ssize_t got = recvfrom(sock, packet, sizeof(packet), 0, reinterpret_cast<struct sockaddr*>(&from), &fromLength);
+        if (got <= 0) return;
+        PacketReader reader(packet, static_cast<size_t>(got));
+        uint32_t magic;
+        uint8_t type, count;
+        DiscoveredPeer peer;
+        if (!reader.u32(magic) || magic != PeerDiscovery::kMagic || !reader.u8(type) || type != PeerDiscovery::kAnnounce ||
+            !reader.u64(peer.id) || !reader.u16(peer.port) || !reader.u16(peer.probePort) || !reader.text(peer.name) ||
+            !reader.u8(count)) {
+            return;
+        }
+        if (from.ss_family == AF_INET6) {
+            auto* from6 = reinterpret_cast<struct sockaddr_in6*>(&from);
+            if (IN6_IS_ADDR_V4MAPPED(&from6->sin6_addr)) return;
+        }
+        peer.candidates.push_back(from);
+        for (uint8_t i = 0; i < count; ++i) {
+            std::string text;
+            struct sockaddr_storage address{};
+            socklen_t length;
+            if (!reader.text(text)) break;
+            if (!TransferProtocol::parseAddress(text, peer.port, address, length)) continue;
+            bool known = std::any_of(peer.candidates.begin(), peer.candidates.end(), [&](const struct sockaddr_storage& other) {
+                return PeerDiscovery::sameHost(other, address);
+            });
+            if (!known) peer.candidates.push_back(address);
+        }
+        peer.lastSeen = std::chrono::steady_clock::now();
+
+        std::lock_guard<std::mutex> lock(mtx);
+        auto existing = std::find_if(found.begin(), found.end(), [&](const DiscoveredPeer& other) { return other.id == peer.id; });
+        if (existing == found.end()) {
+            found.push_back(std::move(peer));
+            return;
+        }
+        for (const auto& candidate : peer.candidates) {
+            bool known = std::any_of(existing->candidates.begin(), existing->candidates.end(), [&](const struct sockaddr_storage& other) {
+                return PeerDiscovery::sameHost(other, candidate);
+            });
+            if (!known) existing->candidates.push_back(candidate);
+        }
+        existing->lastSeen = peer.lastSeen;
+    }
+
+    class PacketReader {
+    public:
+        PacketReader(const char* data, size_t length) : data(data), length(length) {}
+
+        bool u8(uint8_t& value) { return take(&value, 1); }
+        bool u16(uint16_t& value) { return take(&value, 2) && ((value = be16toh(value)), true); }
+        bool u32(uint32_t& value) { return take(&value, 4) && ((value = be32toh(value)), true); }
+        bool u64(uint64_t& value) { return take(&value, 8) && ((value = be64toh(value)), true); }
+        bool text(std::string& value) {
+            uint16_t size;
+            if (!u16(size) || offset + size > length) return false;
+            value.assign(data + offset, size);
+            offset += size;
+            return true;
+        }
+
+    private:
+        const char* data;
+        size_t length;
+        size_t offset = 0;
+
+        bool take(void* out, size_t size) {
+            if (offset + size > length) return false;
+            std::memcpy(out, data + offset, size);
+            offset += size;
+            return true;
+        }
+    };
+};
+#endif
@@ -0,0 +1,797 @@
+#ifndef RECEIVE_DAEMON_HPP
+#define RECEIVE_DAEMON_HPP
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "FileSharingProtocol.hpp"
+#include "TreeTransfer.hpp"
+#include "StreamCompression.hpp"
+#include "ChunkVerifier.hpp"
+
+struct TransferRow {
+    std::string name;
+    uint64_t size;
+    uint64_t received;
+    double rate;
+    int connections;
+    uint64_t socketCalls;
+    double averageRead;
+    double socketSeconds;
+    double diskSeconds;
+    std::string state;
+};
+
+class ReceiveDaemon {
+public:
+    ReceiveDaemon(const std::string& root, int port) : root(root), requestedPort(port) {}
+
+    ~ReceiveDaemon() {
+        stop();
+    }
+
+    bool start() {
+        listenFd = TransferProtocol::listenDualStack(requestedPort, SOCK_NONBLOCK, 128);
+        if (listenFd < 0) return fail("Bind failed");
+
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epollFd < 0 || wakeFd < 0) return fail("Event loop setup failed");
+        watch(listenFd, kListenKey, EPOLLIN, EPOLL_CTL_ADD);
+        watch(wakeFd, kWakeKey, EPOLLIN, EPOLL_CTL_ADD);
+
+        running = true;
+        unsigned writers = std::clamp(std::thread::hardware_concurrency(), 2u, 8u);
+        for (unsigned i = 0; i < writers; ++i) writerPool.emplace_back(&ReceiveDaemon::writeLoop, this);
+        loopThread = std::thread(&ReceiveDaemon::eventLoop, this);
+        return true;
+    }
+
+    void stop() {
+        if (!running.exchange(false)) {
+            closeAll();
+            return;
+        }
+        uint64_t one = 1;
+        write(wakeFd, &one, sizeof(one));
+        loopThread.join();
+        {
+            std::lock_guard<std::mutex> lock(jobMtx);
+            jobsClosed = true;
+        }
+        jobReady.notify_all();
+        for (auto& thread : writerPool) thread.join();
+        writerPool.clear();
+        for (auto& handler : handlers) {
+            if (handler.fd >= 0) shutdown(handler.fd, SHUT_RDWR);
+        }
+        while (!handlers.empty()) reapHandler(handlers.begin());
+        for (auto& entry : connections) close(entry.second.fd);
+        connections.clear();
+        closeAll();
+    }
+
+    int getPort() const {
+        return TransferProtocol::boundPort(listenFd);
+    }
+
+    const std::string& getLastError() const { return lastError; }
+
+    std::vector<TransferRow> snapshot() {
+        std::lock_guard<std::mutex> lock(tableMtx);
+        auto now = std::chrono::steady_clock::now();
+        std::vector<TransferRow> rows;
+        for (const auto& transfer : history) {
+            auto end = transfer->state == Transfer::Receiving ? now : transfer->finishedAt;
+            double seconds = std::chrono::duration<double>(end - transfer->startedAt).count();
+            const TransferStats& stats = transfer->stats;
+            uint64_t received = transfer->resumedFrom + stats.bytes;
+            uint64_t calls = stats.socketCalls;
+            rows.push_back({transfer->header.name, transfer->header.size, received,
+                            seconds > 0 ? (received - transfer->resumedFrom) / seconds : 0.0,
+                            transfer->connections, calls, calls ? static_cast<double>(stats.socketBytes) / calls : 0.0,
+                            stats.socketNanos / 1e9, stats.diskNanos / 1e9,
+                            transfer->verifying ? "verifying" : stateName(transfer->state)});
+        }
+        return rows;
+    }
+
+private:
+    struct Transfer {
+        enum State { Receiving, Complete, Incomplete, Failed };
+        TransferHeader header;
+        std::string path;
+        ChunkBitmap bitmap;
+        int fd = -1;
+        bool compressed = false;
+        std::unique_ptr<ChunkVerifier> verifier;
+        std::vector<ChunkDigest> expected;
+        bool digestsRead = false;
+        std::atomic<bool> verifying{false};
+        int round = 1;
+        std::atomic<State> state{Receiving};
+        std::atomic<int> connections{0};
+        TransferStats stats;
+        uint64_t resumedFrom = 0;
+        uint64_t controlKey = 0;
+        size_t expectedStreams = 0;
+        size_t closedStreams = 0;
+        size_t pendingWrites = 0;
+        bool senderDone = false;
+        std::chrono::steady_clock::time_point startedAt = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point lastActive = startedAt;
+        std::chrono::steady_clock::time_point doneAt;
+        std::chrono::steady_clock::time_point finishedAt;
+
+        ~Transfer() {
+            verifier.reset();
+            if (fd >= 0) close(fd);
+        }
+    };
+
+    enum Phase { Hello, NameLength, Header, WaitDone, DigestCount, Digests, TransferId, ChunkIndex, ChunkLength, ChunkCodec,
+                 PackedLength, ChunkPayload, WritePending };
+
+    struct Connection {
+        int fd;
+        Phase phase = Hello;
+        std::string in{};
+        size_t wanted = 5;
+        std::string out{};
+        std::shared_ptr<Transfer> transfer{};
+        uint32_t chunk = 0;
+        uint32_t length = 0;
+        uint8_t codec = StreamCompression::Stored;
+        bool control = false;
+        std::chrono::steady_clock::time_point lastActive = std::chrono::steady_clock::now();
+    };
+
+    struct Handler {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> done;
+        int fd;
+    };
+
+    struct WriteJob {
+        uint64_t key;
+        std::shared_ptr<Transfer> transfer;
+        uint32_t chunk;
+        uint32_t length;
+        uint8_t codec;
+        std::string data;
+    };
+
+    static constexpr uint64_t kListenKey = 0;
+    static constexpr uint64_t kWakeKey = 1;
+    static constexpr int kStragglerSeconds = 30;
+    static constexpr int kIdleSeconds = 60;
+    static constexpr size_t kHistoryLimit = 100;
+
+    std::string root;
+    int requestedPort;
+    int listenFd = -1;
+    int epollFd = -1;
+    int wakeFd = -1;
+    std::atomic<bool> running{false};
+    std::string lastError;
+    std::thread loopThread;
+    std::vector<std::thread> writerPool;
+    std::list<Handler> handlers;
+
+    uint64_t nextKey = 2;
+    std::chrono::steady_clock::time_point lastIdleSweep = std::chrono::steady_clock::now();
+    std::unordered_map<uint64_t, Connection> connections;
+    std::unordered_map<uint64_t, std::shared_ptr<Transfer>> active;
+
+    std::mutex tableMtx;
+    std::vector<std::shared_ptr<Transfer>> history;
+
+    std::mutex jobMtx;
+    std::condition_variable jobReady;
+    std::deque<WriteJob> jobs;
+    bool jobsClosed = false;
+    std::mutex doneMtx;
+    std::vector<std::pair<uint64_t, bool>> completions;
+    std::vector<std::shared_ptr<Transfer>> verified;
+
+    bool fail(const std::string& message) {
+        lastError = message + ": " + strerror(errno);
+        closeAll();
+        return false;
+    }
+
+    void closeAll() {
+        if (listenFd >= 0) close(listenFd);
+        if (epollFd >= 0) close(epollFd);
+        if (wakeFd >= 0) close(wakeFd);
+        listenFd = epollFd = wakeFd = -1;
+    }
+
+    static std::string stateName(Transfer::State state) {
+        switch (state) {
+            case Transfer::Receiving: return "receiving";
+            case Transfer::Complete: return "done";
+            case Transfer::Incomplete: return "partial";
+            default: return "failed";
+        }
+    }
+
+    void watch(int fd, uint64_t key, uint32_t events, int op) {
+        struct epoll_event event{};
+        event.events = events;
+        event.data.u64 = key;
+        epoll_ctl(epollFd, op, fd, &event);
+    }
+
+    void eventLoop() {
+        std::vector<struct epoll_event> events(256);
+        while (running) {
+            int ready = epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), 1000);
+            if (ready < 0 && errno != EINTR) break;
+            for (int i = 0; i < ready; ++i) {
+                uint64_t key = events[i].data.u64;
+                if (key == kListenKey) {
+                    acceptAll();
+                } else if (key == kWakeKey) {
+                    uint64_t count;
+                    while (read(wakeFd, &count, sizeof(count)) > 0) {}
+                    drainCompletions();
+                } else {
+                    if (events[i].events & EPOLLOUT) flushOut(key);
+                    if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) readReady(key);
+                }
+            }
+            sweepStragglers();
+            sweepIdle();
+            reapHandlers();
+        }
+    }
+
+    void acceptAll() {
+        while (true) {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) return;
+            TransferIO::tuneSocket(fd);
+            uint64_t key = nextKey++;
+            connections.emplace(key, Connection{fd});
+            watch(fd, key, EPOLLIN, EPOLL_CTL_ADD);
+        }
+    }
+
+    void readReady(uint64_t key) {
+        auto it = connections.find(key);
+        if (it == connections.end()) return;
+        Connection& conn = it->second;
+        while (conn.phase != WritePending) {
+            if (conn.in.size() < conn.wanted) {
+                size_t have = conn.in.size();
+                conn.in.resize(conn.wanted);
+                StatsScope scope(conn.transfer ? &conn.transfer->stats : nullptr);
+                SyscallTimer timer(TransferStats::Socket);
+                ssize_t got = timer.done(recv(conn.fd, conn.in.data() + have, conn.wanted - have, 0));
+                if (got < 0 && errno == EINTR) {
+                    conn.in.resize(have);
+                    continue;
+                }
+                if (got < 0 && errno == EAGAIN) {
+                    conn.in.resize(have);
+                    return;
+                }
+                if (got <= 0) {
+                    conn.in.resize(have);
+                    dropConnection(key);
+                    return;
+                }
+                conn.in.resize(have + static_cast<size_t>(got));
+                conn.lastActive = std::chrono::steady_clock::now();
+                if (conn.transfer) conn.transfer->lastActive = conn.lastActive;
+                if (conn.in.size() < conn.wanted) continue;
+            }
+            if (!advance(key, conn)) {
+                dropConnection(key);
+                return;
+            }
+            if (connections.find(key) == connections.end()) return;
+        }
+    }
+
+    static uint32_t be32(const std::string& data, size_t offset) {
+        uint32_t value;
+        std::memcpy(&value, data.data() + offset, sizeof(value));
+        return be32toh(value);
+    }
+
+    static uint64_t be64(const std::string& data, size_t offset) {
+        uint64_t value;
+        std::memcpy(&value, data.data() + offset, sizeof(value));
+        return be64toh(value);
+    }
+
+    void expect(Connection& conn, Phase phase, size_t bytes) {
+        conn.phase = phase;
+        conn.in.clear();
+        conn.wanted = bytes;
+    }
+
+    bool advance(uint64_t key, Connection& conn) {
+        switch (conn.phase) {
+            case Hello: {
+                if (be32(conn.in, 0) != TransferProtocol::kMagic) return false;
+                uint8_t type = static_cast<uint8_t>(conn.in[4]);
+                if (type == TransferProtocol::Control) {
+                    conn.control = true;
+                    expect(conn, NameLength, 2);
+                } else if (type == TransferProtocol::Data) {
+                    expect(conn, TransferId, 8);
+                } else {
+                    return false;
+                }
+                return true;
+            }
+            case NameLength: {
+                uint16_t length;
+                std::memcpy(&length, conn.in.data(), sizeof(length));
+                expect(conn, Header, be16toh(length) + 34);
+                return true;
+            }
+            case Header:
+                return openTransfer(key, conn);
+            case WaitDone:
+                if (conn.transfer->verifier && !conn.transfer->digestsRead) {
+                    expect(conn, DigestCount, 4);
+                    return true;
+                }
+                senderDone(conn);
+                return true;
+            case DigestCount: {
+                uint32_t count = be32(conn.in, 0);
+                if (count != conn.transfer->header.chunkCount() || count > TransferProtocol::kMaxChunks) return false;
+                expect(conn, Digests, (static_cast<size_t>(count) + 1) * 32);
+                return true;
+            }
+            case Digests: {
+                auto transfer = conn.transfer;
+                if (!ChunkVerifier::parseDigests(conn.in, transfer->header.size, transfer->expected)) return false;
+                transfer->digestsRead = true;
+                senderDone(conn);
+                return true;
+            }
+            case TransferId: {
+                auto found = active.find(be64(conn.in, 0));
+                if (found == active.end()) return false;
+                conn.transfer = found->second;
+                ++conn.transfer->connections;
+                expect(conn, ChunkIndex, 4);
+                return true;
+            }
+            case ChunkIndex: {
+                if (conn.transfer->state != Transfer::Receiving) return false;
+                conn.chunk = be32(conn.in, 0);
+                if (conn.chunk == TransferProtocol::kEndOfChunks) {
+                    closeStream(conn);
+                    return false;
+                }
+                expect(conn, ChunkLength, 4);
+                return true;
+            }
+            case ChunkLength: {
+                const TransferHeader& header = conn.transfer->header;
+                conn.length = be32(conn.in, 0);
+                if (conn.chunk >= header.chunkCount() || conn.length != header.chunkLength(conn.chunk)) return false;
+                conn.codec = StreamCompression::Stored;
+                if (conn.transfer->compressed) {
+                    expect(conn, ChunkCodec, 1);
+                } else {
+                    expect(conn, ChunkPayload, conn.length);
+                }
+                return true;
+            }
+            case ChunkCodec:
+                conn.codec = static_cast<uint8_t>(conn.in[0]);
+                if (conn.codec == StreamCompression::Deflate) {
+                    expect(conn, PackedLength, 4);
+                } else if (conn.codec == StreamCompression::Stored) {
+                    expect(conn, ChunkPayload, conn.length);
+                } else {
+                    return false;
+                }
+                return true;
+            case PackedLength: {
+                uint32_t packed = be32(conn.in, 0);
+                if (packed > conn.length) return false;
+                expect(conn, ChunkPayload, packed);
+                return true;
+            }
+            case ChunkPayload:
+                submitWrite(key, conn);
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    void senderDone(Connection& conn) {
+        auto transfer = conn.transfer;
+        transfer->senderDone = true;
+        transfer->doneAt = std::chrono::steady_clock::now();
+        expect(conn, WaitDone, 1);
+        maybeFinish(transfer);
+    }
+
+    std::string targetPath(const std::string& senderName) {
+        std::string name = std::filesystem::path(senderName).filename().string();
+        if (name.empty() || name == "." || name == "..") name = "received.bin";
+        return (std::filesystem::path(root) / name).string();
+    }
+
+    bool openTransfer(uint64_t key, Connection& conn) {
+        auto transfer = std::make_shared<Transfer>();
+        TransferHeader& header = transfer->header;
+        size_t nameLength = conn.in.size() - 34;
+        header.name = conn.in.substr(0, nameLength);
+        const size_t base = nameLength;
+        header.size = be64(conn.in, base);
+        header.mtime = be64(conn.in, base + 8);
+        header.chunkSize = be32(conn.in, base + 16);
+        uint16_t streams;
+        std::memcpy(&streams, conn.in.data() + base + 20, sizeof(streams));
+        header.streams = be16toh(streams);
+        header.flags = be32(conn.in, base + 22);
+        header.transferId = be64(conn.in, base + 26);
+        if (!header.withinLimits()) return false;
+        transfer->path = targetPath(header.name);
+        transfer->controlKey = key;
+        transfer->connections = 1;
+        conn.transfer = transfer;
+        if (pathInUse(transfer->path)) {
+            reject(key, conn);
+            return true;
+        }
+
+        if (header.flags & TransferProtocol::kFlagTree) {
+            publish(transfer);
+            handOffTree(key, conn);
+            return true;
+        }
+
+        bool deltaRequested = (header.flags & TransferProtocol::kFlagDelta) != 0;
+        transfer->fd = open(transfer->path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (transfer->fd < 0 || !transfer->bitmap.open(transfer->path + ".resume", header)) {
+            reject(key, conn);
+            return true;
+        }
+        if (transfer->bitmap.isFresh()) {
+            ftruncate(transfer->fd, 0);
+            TransferIO::preallocate(transfer->fd, header.size);
+        }
+
+        std::vector<uint32_t> missing = ChunkBitmap::missing(transfer->bitmap.raw(), transfer->bitmap.size());
+        uint64_t alreadyHave = header.size;
+        for (uint32_t chunk : missing) alreadyHave -= header.chunkLength(chunk);
+        transfer->resumedFrom = alreadyHave;
+        transfer->stats.begin(header.size - alreadyHave);
+        transfer->expectedStreams = std::min<size_t>(header.streams, missing.size());
+        transfer->compressed = (header.flags & TransferProtocol::kFlagCompress) != 0;
+        if (header.flags & TransferProtocol::kFlagVerify) {
+            transfer->verifier = std::make_unique<ChunkVerifier>(transfer->fd, transfer->header);
+            transfer->verifier->addPresent(transfer->bitmap);
+            transfer->verifier->start();
+        }
+        active[header.transferId] = transfer;
+
+        WireBuffer reply;
+        reply.putU8(TransferProtocol::Ok);
+        if (deltaRequested) reply.putU8(TransferProtocol::Chunked);
+        if (transfer->compressed) reply.putU8(1);
+        if (transfer->verifier) reply.putU8(1);
+        reply.putU32(static_cast<uint32_t>(transfer->bitmap.raw().size()));
+        conn.out += reply.contents();
+        conn.out.append(reinterpret_cast<const char*>(transfer->bitmap.raw().data()), transfer->bitmap.raw().size());
+        publish(transfer);
+        expect(conn, WaitDone, 1);
+        flushOut(key);
+        return true;
+    }
+
+    bool pathInUse(const std::string& path) {
+        std::lock_guard<std::mutex> lock(tableMtx);
+        for (const auto& transfer : history) {
+            if (transfer->state == Transfer::Receiving && transfer->path == path) return true;
+        }
+        return false;
+    }
+
+    void reject(uint64_t key, Connection& conn) {
+        std::shared_ptr<Transfer> transfer = conn.transfer;
+        transfer->state = Transfer::Failed;
+        transfer->finishedAt = std::chrono::steady_clock::now();
+        transfer->connections = 0;
+        releaseFiles(*transfer);
+        publish(transfer);
+        conn.out.push_back(static_cast<char>(TransferProtocol::Rejected));
+        if (!(transfer->header.flags & TransferProtocol::kFlagTree)) conn.out.append(4, '\0');
+        expect(conn, WaitDone, 1);
+        flushOut(key);
+    }
+
+    void publish(const std::shared_ptr<Transfer>& transfer) {
+        std::lock_guard<std::mutex> lock(tableMtx);
+        history.push_back(transfer);
+        auto it = history.begin();
+        while (history.size() > kHistoryLimit && it != history.end()) {
+            it = (*it)->state == Transfer::Receiving ? std::next(it) : history.erase(it);
+        }
+    }
+
+    static void releaseFiles(Transfer& transfer) {
+        transfer.verifier.reset();
+        if (transfer.fd >= 0) close(transfer.fd);
+        transfer.fd = -1;
+        transfer.bitmap.closeFile();
+    }
+
+    void handOffTree(uint64_t key, Connection& conn) {
+        int fd = conn.fd;
+        std::shared_ptr<Transfer> transfer = conn.transfer;
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        connections.erase(key);
+        startHandler(fd, [fd, transfer]() {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+            StatsScope scope(&transfer->stats);
+            transfer->stats.begin(transfer->header.size);
+            WireBuffer reply;
+            reply.putU8(TransferProtocol::Ok);
+            uint64_t files = 0;
+            bool complete = reply.flush(fd) && TreeReceiver(transfer->path).receive(fd, files);
+            WireBuffer done;
+            done.putU8(complete ? TransferProtocol::Ok : TransferProtocol::Incomplete);
+            done.flush(fd);
+            transfer->connections = 0;
+            transfer->finishedAt = std::chrono::steady_clock::now();
+            transfer->state = complete ? Transfer::Complete : Transfer::Failed;
+        });
+    }
+
+    template <typename Work>
+    void startHandler(int fd, Work work) {
+        auto done = std::make_shared<std::atomic<bool>>(false);
+        handlers.push_back({std::thread([work, done]() {
+            work();
+            *done = true;
+        }), done, fd});
+    }
+
+    std::list<Handler>::iterator reapHandler(std::list<Handler>::iterator it) {
+        it->thread.join();
+        if (it->fd >= 0) close(it->fd);
+        return handlers.erase(it);
+    }
+
+    void reapHandlers() {
+        for (auto it = handlers.begin(); it != handlers.end();) {
+            it = *it->done ? reapHandler(it) : std::next(it);
+        }
+    }
+
+    void flushOut(uint64_t key) {
+        auto it = connections.find(key);
+        if (it == connections.end()) return;
+        Connection& conn = it->second;
+        while (!conn.out.empty()) {
+            ssize_t sent = send(conn.fd, conn.out.data(), conn.out.size(), MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR) continue;
+            if (sent < 0 && errno == EAGAIN) break;
+            if (sent <= 0) {
+                conn.out.clear();
+                break;
+            }
+            conn.out.erase(0, static_cast<size_t>(sent));
+        }
+        uint32_t events = conn.phase == WritePending ? 0 : static_cast<uint32_t>(EPOLLIN);
+        if (!conn.out.empty()) events |= EPOLLOUT;
+        watch(conn.fd, key, events, EPOLL_CTL_MOD);
+    }
+
+    void submitWrite(uint64_t key, Connection& conn) {
+        ++conn.transfer->pendingWrites;
+        WriteJob job{key, conn.transfer, conn.chunk, conn.length, conn.codec, std::move(conn.in)};
+        expect(conn, WritePending, 0);
+        watch(conn.fd, key, 0, EPOLL_CTL_MOD);
+        {
+            std::lock_guard<std::mutex> lock(jobMtx);
+            jobs.push_back(std::move(job));
+        }
+        jobReady.notify_one();
+    }
+
+    void writeLoop() {
+        std::string raw;
+        while (true) {
+            WriteJob job;
+            {
+                std::unique_lock<std::mutex> lock(jobMtx);
+                jobReady.wait(lock, [this]() { return jobsClosed || !jobs.empty(); });
+                if (jobs.empty()) return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            Transfer& transfer = *job.transfer;
+            StatsScope scope(&transfer.stats);
+            off_t offset = static_cast<off_t>(job.chunk) * transfer.header.chunkSize;
+            bool ok = true;
+            if (job.codec == StreamCompression::Deflate) {
+                ok = StreamCompression::decompress(job.data, job.length, raw);
+                job.data.swap(raw);
+            }
+            ok = ok && TransferIO::pwriteAll(transfer.fd, job.data.data(), job.length, offset);
+            if (ok && !transfer.bitmap.test(job.chunk)) {
+                transfer.bitmap.mark(job.chunk);
+                if (transfer.verifier) transfer.verifier->add(job.chunk);
+                TransferStats::reportProgress(job.length);
+            }
+            {
+                std::lock_guard<std::mutex> lock(doneMtx);
+                completions.emplace_back(job.key, ok);
+            }
+            uint64_t one = 1;
+            write(wakeFd, &one, sizeof(one));
+        }
+    }
+
+    void drainCompletions() {
+        std::vector<std::pair<uint64_t, bool>> finished;
+        std::vector<std::shared_ptr<Transfer>> checked;
+        {
+            std::lock_guard<std::mutex> lock(doneMtx);
+            finished.swap(completions);
+            checked.swap(verified);
+        }
+        for (const auto& transfer : checked) concludeVerification(transfer);
+        for (const auto& [key, ok] : finished) {
+            auto it = connections.find(key);
+            if (it == connections.end()) continue;
+            Connection& conn = it->second;
+            std::shared_ptr<Transfer> transfer = conn.transfer;
+            --transfer->pendingWrites;
+            expect(conn, ChunkIndex, 4);
+            if (!ok) {
+                dropConnection(key);
+                continue;
+            }
+            watch(conn.fd, key, EPOLLIN, EPOLL_CTL_MOD);
+            readReady(key);
+        }
+    }
+
+    void closeStream(Connection& conn) {
+        if (!conn.transfer || conn.control) return;
+        std::shared_ptr<Transfer> transfer = conn.transfer;
+        conn.transfer.reset();
+        --transfer->connections;
+        ++transfer->closedStreams;
+        maybeFinish(transfer);
+    }
+
+    void dropConnection(uint64_t key) {
+        auto it = connections.find(key);
+        if (it == connections.end()) return;
+        Connection& conn = it->second;
+        std::shared_ptr<Transfer> transfer = conn.transfer;
+        bool control = conn.control;
+        closeStream(conn);
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, conn.fd, nullptr);
+        close(conn.fd);
+        connections.erase(it);
+        if (control && transfer && transfer->state == Transfer::Receiving) {
+            transfer->controlKey = 0;
+            transfer->senderDone = true;
+            transfer->doneAt = std::chrono::steady_clock::now();
+            maybeFinish(transfer);
+        }
+    }
+
+    void maybeFinish(const std::shared_ptr<Transfer>& transfer) {
+        if (transfer->state != Transfer::Receiving || !transfer->senderDone || transfer->pendingWrites > 0 ||
+            transfer->verifying) {
+            return;
+        }
+        bool stragglers = std::chrono::steady_clock::now() - transfer->doneAt < std::chrono::seconds(kStragglerSeconds);
+        if (transfer->closedStreams < transfer->expectedStreams && transfer->controlKey != 0 && stragglers) return;
+        if (!transfer->verifier || !transfer->digestsRead) {
+            finish(transfer);
+            return;
+        }
+        transfer->verifying = true;
+        startHandler(-1, [this, transfer]() {
+            transfer->verifier->finish();
+            {
+                std::lock_guard<std::mutex> lock(doneMtx);
+                verified.push_back(transfer);
+            }
+            uint64_t one = 1;
+            write(wakeFd, &one, sizeof(one));
+        });
+    }
+
+    void concludeVerification(const std::shared_ptr<Transfer>& transfer) {
+        for (uint32_t chunk : transfer->verifier->mismatches(transfer->expected, transfer->bitmap)) {
+            transfer->bitmap.clear(chunk);
+            transfer->resumedFrom -= transfer->header.chunkLength(chunk);
+        }
+        transfer->verifying = false;
+        std::vector<uint32_t> missing = ChunkBitmap::missing(transfer->bitmap.raw(), transfer->bitmap.size());
+        auto control = connections.find(transfer->controlKey);
+        if (missing.empty() || transfer->round == ChunkVerifier::kMaxRounds || control == connections.end()) {
+            finish(transfer);
+            return;
+        }
+        ++transfer->round;
+        transfer->senderDone = false;
+        transfer->closedStreams = 0;
+        transfer->expectedStreams = std::min<size_t>(transfer->header.streams, missing.size());
+        for (uint32_t chunk : missing) transfer->stats.expected += transfer->header.chunkLength(chunk);
+        WireBuffer retry;
+        retry.putU8(TransferProtocol::Retry);
+        retry.putU32(static_cast<uint32_t>(transfer->bitmap.raw().size()));
+        control->second.out += retry.contents();
+        control->second.out.append(reinterpret_cast<const char*>(transfer->bitmap.raw().data()), transfer->bitmap.raw().size());
+        flushOut(transfer->controlKey);
+    }
+
+    void finish(const std::shared_ptr<Transfer>& transfer) {
+        bool complete = transfer->bitmap.complete() && (!transfer->verifier || transfer->digestsRead);
+        if (complete) {
+            ftruncate(transfer->fd, static_cast<off_t>(transfer->header.size));
+            transfer->bitmap.remove();
+        }
+        releaseFiles(*transfer);
+        active.erase(transfer->header.transferId);
+        transfer->finishedAt = std::chrono::steady_clock::now();
+        transfer->state = complete ? Transfer::Complete : Transfer::Incomplete;
+        transfer->connections = 0;
+
+        auto it = connections.find(transfer->controlKey);
+        if (it == connections.end()) return;
+        it->second.out.push_back(static_cast<char>(complete ? TransferProtocol::Ok : TransferProtocol::Incomplete));
+        flushOut(transfer->controlKey);
+    }
+
+    void sweepStragglers() {
+        std::vector<std::shared_ptr<Transfer>> waiting;
+        for (const auto& entry : active) {
+            if (entry.second->senderDone) waiting.push_back(entry.second);
+        }
+        for (const auto& transfer : waiting) maybeFinish(transfer);
+    }
+
+    void sweepIdle() {
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastIdleSweep < std::chrono::seconds(1)) return;
+        lastIdleSweep = now;
+        std::vector<uint64_t> idle;
+        for (const auto& [key, conn] : connections) {
+            if (conn.phase == WritePending || (conn.transfer && conn.transfer->verifying)) continue;
+            auto seen = conn.lastActive;
+            if (conn.transfer && conn.transfer->state == Transfer::Receiving) seen = std::max(seen, conn.transfer->lastActive);
+            if (now - seen >= std::chrono::seconds(kIdleSeconds)) idle.push_back(key);
+        }
+        for (uint64_t key : idle) dropConnection(key);
+    }
+};
+#endif
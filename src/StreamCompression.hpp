@@ -0,0 +1,226 @@
+#ifndef STREAM_COMPRESSION_HPP
+#define STREAM_COMPRESSION_HPP
+
+#include <zlib.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "FileSharingProtocol.hpp"
+
+class StreamCompression {
+public:
+    enum Codec : uint8_t {
+        Stored = 0,
+        Deflate = 1,
+    };
+
+    static constexpr size_t kSampleSize = 4096;
+    static constexpr double kEntropyLimit = 7.5;
+    static constexpr double kRatioLimit = 0.9;
+
+    static double sampleEntropy(int fd, off_t offset, uint32_t length) {
+        unsigned counts[256] = {};
+        std::vector<unsigned char> sample(kSampleSize);
+        size_t total = 0;
+        for (int i = 0; i < 3; ++i) {
+            off_t at = offset + static_cast<off_t>((static_cast<uint64_t>(length) * i) / 3);
+            ssize_t got = pread(fd, sample.data(), std::min<size_t>(kSampleSize, length), at);
+            if (got <= 0) continue;
+            for (ssize_t j = 0; j < got; ++j) ++counts[sample[j]];
+            total += static_cast<size_t>(got);
+        }
+        if (total == 0) return 8.0;
+        double entropy = 0;
+        for (unsigned count : counts) {
+            if (count == 0) continue;
+            double p = static_cast<double>(count) / total;
+            entropy -= p * std::log2(p);
+        }
+        return entropy;
+    }
+
+    static bool compress(const std::string& input, int level, std::string& output) {
+        uLongf bound = compressBound(static_cast<uLong>(input.size()));
+        output.resize(bound);
+        if (compress2(reinterpret_cast<Bytef*>(output.data()), &bound,
+                      reinterpret_cast<const Bytef*>(input.data()), static_cast<uLong>(input.size()), level) != Z_OK) {
+            return false;
+        }
+        output.resize(bound);
+        return true;
+    }
+
+    static bool decompress(const std::string& input, uint32_t length, std::string& output) {
+        output.resize(length);
+        uLongf produced = length;
+        return uncompress(reinterpret_cast<Bytef*>(output.data()), &produced,
+                          reinterpret_cast<const Bytef*>(input.data()), static_cast<uLong>(input.size())) == Z_OK &&
+               produced == length;
+    }
+};
+
+struct EncodedChunk {
+    uint32_t index = 0;
+    StreamCompression::Codec codec = StreamCompression::Stored;
+    std::string payload;
+};
+
+class ChunkPipeline {
+public:
+    ChunkPipeline(int fd, const TransferHeader& header, const std::vector<uint32_t>& chunks, size_t streams)
+        : fd(fd), header(header), chunks(chunks), streams(std::max<size_t>(1, streams)),
+          capacity(std::max<size_t>(2, streams * 2)) {}
+
+    ~ChunkPipeline() {
+        stop();
+    }
+
+    void start() {
+        unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        workers = std::clamp<size_t>(cores > 1 ? cores - 1 : 1, 1, capacity);
+        active = workers;
+        for (size_t i = 0; i < workers; ++i) pool.emplace_back(&ChunkPipeline::compressLoop, this);
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopped = true;
+        }
+        spaceReady.notify_all();
+        chunkReady.notify_all();
+        for (auto& thread : pool) thread.join();
+        pool.clear();
+    }
+
+    bool next(EncodedChunk& chunk) {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (true) {
+            if (!ready.empty()) {
+                chunk = std::move(ready.front());
+                ready.pop_front();
+                spaceReady.notify_one();
+                return true;
+            }
+            if (active > 0 && compressionPays()) {
+                chunkReady.wait(lock);
+                continue;
+            }
+            size_t i = cursor.fetch_add(1);
+            if (i < chunks.size()) {
+                level = std::max(1, level.load() - 1);
+                chunk.index = chunks[i];
+                chunk.codec = StreamCompression::Stored;
+                chunk.payload.clear();
+                return true;
+            }
+            if (active == 0 || stopped) return false;
+            chunkReady.wait(lock);
+        }
+    }
+
+    void recordDrain(uint64_t drainedBytes, std::chrono::nanoseconds elapsed) {
+        std::lock_guard<std::mutex> lock(mtx);
+        linkRate = blend(linkRate, drainedBytes * 1e9 / std::max<int64_t>(1, elapsed.count()));
+    }
+
+    int currentLevel() const { return level; }
+    uint64_t getCompressedChunks() const { return compressedChunks; }
+
+private:
+    static constexpr int kMaxLevel = 6;
+    static constexpr unsigned kProbeInterval = 8;
+    static constexpr uint32_t kProbeBytes = 256 << 10;
+    int fd;
+    const TransferHeader& header;
+    const std::vector<uint32_t>& chunks;
+    size_t streams;
+    size_t capacity;
+    size_t workers = 1;
+    double linkRate = 0;
+    double compressRate = 0;
+    std::atomic<size_t> cursor{0};
+    std::atomic<uint64_t> compressedChunks{0};
+    std::vector<std::thread> pool;
+    std::mutex mtx;
+    std::condition_variable chunkReady;
+    std::condition_variable spaceReady;
+    std::deque<EncodedChunk> ready;
+    size_t active = 0;
+    std::atomic<int> level{1};
+    bool stopped = false;
+
+    static double blend(double average, double sample) {
+        return average == 0 ? sample : average * 0.7 + sample * 0.3;
+    }
+
+    bool compressionPays() const {
+        return linkRate > 0 && compressRate * workers > linkRate * streams;
+    }
+
+    void compressLoop() {
+        std::string raw;
+        unsigned skipped = kProbeInterval - 1;
+        size_t i;
+        while ((i = cursor.fetch_add(1)) < chunks.size()) {
+            EncodedChunk chunk;
+            chunk.index = chunks[i];
+            bool pays;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                pays = compressionPays();
+            }
+            if (pays) {
+                encode(chunk, raw, false);
+            } else if (++skipped % kProbeInterval == 0) {
+                encode(chunk, raw, true);
+            }
+            std::unique_lock<std::mutex> lock(mtx);
+            if (ready.size() >= capacity && chunk.codec == StreamCompression::Deflate) {
+                level = std::min(kMaxLevel, level.load() + 1);
+            }
+            spaceReady.wait(lock, [this]() { return stopped || ready.size() < capacity; });
+            if (stopped) break;
+            ready.push_back(std::move(chunk));
+            chunkReady.notify_one();
+        }
+        std::lock_guard<std::mutex> lock(mtx);
+        --active;
+        chunkReady.notify_all();
+    }
+
+    void encode(EncodedChunk& chunk, std::string& raw, bool probeOnly) {
+        uint32_t length = header.chunkLength(chunk.index);
+        if (probeOnly) length = std::min(length, kProbeBytes);
+        off_t offset = static_cast<off_t>(chunk.index) * header.chunkSize;
+        if (StreamCompression::sampleEntropy(fd, offset, length) > StreamCompression::kEntropyLimit) return;
+
+        auto started = std::chrono::steady_clock::now();
+        raw.resize(length);
+        if (pread(fd, raw.data(), length, offset) != static_cast<ssize_t>(length)) return;
+        std::string packed;
+        bool packedOk = StreamCompression::compress(raw, level, packed);
+        auto elapsed = std::chrono::steady_clock::now() - started;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            compressRate = blend(compressRate, length * 1e9 / std::max<int64_t>(1, std::chrono::nanoseconds(elapsed).count()));
+        }
+        if (probeOnly) return;
+        if (packedOk && packed.size() < length * StreamCompression::kRatioLimit) {
+            chunk.codec = StreamCompression::Deflate;
+            chunk.payload = std::move(packed);
+            ++compressedChunks;
+        } else {
+            chunk.payload = raw;
+        }
+    }
+};
+#endif
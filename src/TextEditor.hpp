@@ -8,6 +8,7 @@
 #include <filesystem>
 #include <algorithm>
 #include "VersionManager.hpp"
+#include "VersionDiff.hpp"
 
 namespace fs = std::filesystem;
 
@@ -264,6 +265,7 @@ private:
         }
 
         int selected = 0;
+        int marked = -1;
         while (true) {
             clear();
             mvprintw(0, (COLS - 20) / 2, "Select a version:");
@@ -272,11 +274,12 @@ private:
                 if (i == selected) {
                     attron(A_REVERSE);
                 }
-                mvprintw(i + 2, (COLS - 20) / 2, "%s", versions[i].c_str());
+                mvprintw(i + 2, (COLS - 20) / 2, "%s%s", versions[i].c_str(), static_cast<int>(i) == marked ? " *" : "");
                 if (i == selected) {
                     attroff(A_REVERSE);
                 }
             }
+            mvprintw(LINES - 1, 0, "Enter restore | d diff (vs buffer, or vs marked) | Space mark | Esc back");
 
             refresh();
             int ch = getch();
@@ -285,6 +288,10 @@ private:
                 --selected;
             } else if (ch == KEY_DOWN && selected < versions.size() - 1) {
                 ++selected;
+            } else if (ch == ' ') {
+                marked = (marked == selected) ? -1 : selected;
+            } else if (ch == 'd') {
+                showVersionDiff(versions, marked, selected);
             } else if (ch == '\n') {
                 versionManager.restoreVersion(versions[selected], filename);
                 loadFile();
@@ -295,6 +302,21 @@ private:
         }
     }
 
+    void showVersionDiff(const std::vector<std::string>& versions, int marked, int selected) {
+        std::vector<std::string> newLines;
+        if (!versionManager.readVersion(versions[selected], newLines)) return;
+
+        if (marked >= 0 && marked != selected) {
+            std::vector<std::string> oldLines;
+            if (!versionManager.readVersion(versions[marked], oldLines)) return;
+            DiffViewer viewer(versions[marked], oldLines, versions[selected], newLines);
+            viewer.run();
+        } else {
+            DiffViewer viewer(versions[selected], newLines, filename + " (buffer)", buffer.getLines());
+            viewer.run();
+        }
+    }
+
     void handleBackspace(bool& isModified) {
         if (x > 1) {
             buffer.getLines()[y].erase(x - 2, 1);
@@ -8,6 +8,7 @@
 #include <condition_variable>
 #include <functional>
 #include <memory>
+#include <set>
 #include <libtorrent/session.hpp>
 #include <libtorrent/torrent_info.hpp>
 #include <libtorrent/alert.hpp>
@@ -17,65 +18,246 @@
 #include <libtorrent/magnet_uri.hpp>
 #include <libtorrent/read_resume_data.hpp>
 #include <libtorrent/write_resume_data.hpp>
+#include <libtorrent/session_params.hpp>
+#include <libtorrent/create_torrent.hpp>
+#include <libtorrent/bencode.hpp>
+#include <libtorrent/session_stats.hpp>
+#include <libtorrent/mmap_disk_io.hpp>
+#include <libtorrent/posix_disk_io.hpp>
 #include <chrono>
+#include <ctime>
 #include <filesystem>
 #include <fstream>
 #include <atomic>
 #include <iomanip>
 #include <algorithm>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "TorrentProfiles.hpp"
 
 const std::string RESUME_DIR = "./RESUME_DATA/";
+const std::string SESSION_STATE_FILE = RESUME_DIR + "session.state";
+const auto SESSION_STATE_FLAGS = libtorrent::session_handle::save_dht_state | libtorrent::session_handle::save_ip_filter;
 
 void ensureResumeDirectory() {
     std::filesystem::create_directories(RESUME_DIR);
 }
 
-class Torrent {
+struct TorrentSessionStats {
+    std::string profile;
+    std::string configError;
+    double downloadRate = 0;
+    double uploadRate = 0;
+    bool warmStart = false;
+    int64_t dhtNodes = 0;
+    int64_t peers = 0;
+    int64_t unchoked = 0;
+    int64_t diskJobs = 0;
+    int64_t diskQueuedBytes = 0;
+    int64_t blocksHashed = 0;
+    double readSeconds = 0;
+    double writeSeconds = 0;
+    double hashSeconds = 0;
+    std::string schedule;
+};
+
+struct TorrentRow {
+    uint64_t id;
+    std::string name;
+    std::string state;
+    std::string error;
+    float progress;
+    int downloadRate;
+    int uploadRate;
+    int peers;
+    int seeds;
+    int queuePosition;
+    int64_t eta;
+    bool paused;
+    bool finished;
+    double firstPeerSeconds;
+    double fullRateSeconds;
+    int peakRate;
+    int downloadLimit;
+    int uploadLimit;
+    bool sequential;
+};
+
+struct TorrentCreationRow {
+    std::string name;
+    int piecesDone;
+    int pieces;
+    std::string error;
+};
+
+struct TorrentFileRow {
+    int index;
+    std::string path;
+    int64_t size;
+    int64_t done;
+    int priority;
+};
+
+class TorrentManager {
     public:
-    Torrent(std::shared_ptr<libtorrent::session> session, const std::string& input);
-    ~Torrent();
-    float getProgress() const { return progress; }
-    int getPeers() const { return peers; }
-    float getSpeed() const { return speed; }
-    bool isCompleted() const { return completed; }
-    std::string getErrorMessage() const { return errorMessage; }
-    std::tuple<float, int, float> getTorrentStatus();
-    void handleAlerts();
-    void stopDownload();
-    std::string getTorrentName() const;
-    bool verifyTorrent(const std::string& input);
+    static constexpr auto kIdleUpdateInterval = std::chrono::seconds(1);
+    static constexpr auto kLiveUpdateInterval = std::chrono::milliseconds(100);
+    static constexpr auto kCheckpointInterval = std::chrono::seconds(30);
+    static constexpr auto kShutdownTimeout = std::chrono::seconds(5);
+    static constexpr double kFullRateFraction = 0.9;
+    static constexpr int kMinPieceSize = 256 * 1024;
+    static constexpr int kMaxPieceSize = 16 * 1024 * 1024;
+    static constexpr int64_t kTargetPieces = 2000;
+
+    TorrentManager() : updateFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {}
+    ~TorrentManager();
+    static bool verifyTorrent(const std::string& input);
+    static constexpr int kSkip = 0;
+    static constexpr int kNormal = 4;
+    static constexpr int kHigh = 7;
+
+    bool addTorrent(const std::string& input, uint64_t& id);
+    void restore();
+    void togglePause(uint64_t id);
+    void removeTorrent(uint64_t id);
+    void moveInQueue(uint64_t id, bool up);
+    std::vector<TorrentFileRow> files(uint64_t id);
+    void setFilePriority(uint64_t id, int index, int priority);
+    void setLimits(uint64_t id, int downloadKiB, int uploadKiB);
+    void toggleSequential(uint64_t id);
+    void createTorrent(const std::string& path);
+    std::vector<TorrentCreationRow> creations();
+    std::vector<TorrentRow> snapshot();
+    size_t activeCount();
+    TorrentSessionStats sessionStats();
+    void cycleProfile();
+    void setLiveUpdates(bool live);
+    int getUpdateFd() const { return updateFd; }
+    void drainUpdates();
+    std::string getLastError() const { return lastError; }
 
     private:
-    mutable std::mutex statusMutex;
-    std::shared_ptr<libtorrent::session> session;
-    libtorrent::torrent_handle handle;
-    float progress = 0.0f;
-    int peers = 0;
-    float speed = 0.0f;
-    bool completed = false;
-    std::string errorMessage;
-    std::thread downloadThread;
-    bool stopFlag = false;
-    void addTorrent(const std::string& input);
-    void download();
-    void saveResumeData();
-    void loadResumeData(const std::string& torrentFile);
-    std::string determineSavePath(const std::string& torrentFile);
+    struct Entry {
+        uint64_t id;
+        std::string key;
+        std::string label;
+        libtorrent::torrent_handle handle;
+        libtorrent::torrent_status status;
+        std::string error;
+        std::chrono::steady_clock::time_point addedAt = std::chrono::steady_clock::now();
+        double firstPeerSeconds = -1;
+        double fullRateSeconds = -1;
+        int peakRate = 0;
+        int reachedRate = 0;
+        int downloadLimit = 0;
+        int uploadLimit = 0;
+        int outstandingSaves = 0;
+        bool finalSave = false;
+    };
+
+    struct Creation {
+        uint64_t id;
+        std::string name;
+        int piecesDone = 0;
+        int pieces = 0;
+        std::string error;
+    };
+    struct CreationCancelled {};
+
+    struct Creator {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> done;
+    };
+
+    std::unique_ptr<libtorrent::session> session;
+    std::mutex mtx;
+    std::condition_variable saved;
+    std::vector<Entry> torrents;
+    std::vector<Creation> creating;
+    std::vector<Creator> creators;
+    std::atomic<bool> cancelCreation{false};
+    size_t pendingSaves = 0;
+    size_t answeredSaves = 0;
+    std::vector<std::pair<std::string, libtorrent::add_torrent_params>> resumeBatch;
+    std::set<std::string> removedKeys;
+    TorrentProfiles profiles;
+    TorrentSessionStats stats;
+    std::vector<int64_t> lastCounters;
+    std::chrono::steady_clock::time_point lastCountersAt;
+    int scheduleWindow = -2;
+    std::mutex notifyMtx;
+    std::condition_variable wake;
+    bool alertsPending = false;
+    bool live = false;
+    bool stopping = false;
+    std::thread alertThread;
+    int updateFd;
+    uint64_t nextId = 1;
+    std::string lastError;
+
+    void startSession();
+    bool add(libtorrent::add_torrent_params params, const std::string& label, libtorrent::torrent_handle& handle, uint64_t& id,
+             std::string& error);
+    void alertLoop();
+    void runCreation(uint64_t id, const std::string& path);
+    void updateCreation(uint64_t id, const std::function<void(Creation&)>& update);
+    static int pieceSizeFor(int64_t totalSize);
+    void dispatch(libtorrent::alert* alert);
+    void onStateUpdate(const libtorrent::state_update_alert& update);
+    void onSessionStats(const libtorrent::session_stats_alert& update);
+    void applyProfile(const std::string& name);
+    void applySchedule(bool force);
+    void signalUpdate();
+    void requestCheckpoint();
+    static void requestSave(Entry& entry, libtorrent::resume_data_flags_t flags);
+    void answerSave(const libtorrent::torrent_handle& handle);
+    void finishSaves(const std::vector<std::pair<std::string, libtorrent::add_torrent_params>>& batch);
+    static void writeResumeBatch(const std::vector<std::pair<std::string, libtorrent::add_torrent_params>>& batch);
+    static bool writeAtomically(const std::string& path, const std::vector<char>& buffer);
+    static void syncResumeDirectory();
+    static bool loadSessionState(libtorrent::session_params& params);
+    static void trackStartup(Entry& entry);
+    Entry* find(uint64_t id);
+    Entry* find(const libtorrent::torrent_handle& handle);
+    static std::string resumeKey(const libtorrent::info_hash_t& hashes);
+    static std::string resumePath(const std::string& key);
+    static bool loadResumeData(const std::string& path, libtorrent::add_torrent_params& params);
+    static std::string determineSavePath(const std::string& torrentFile);
+    static std::string stateName(const libtorrent::torrent_status& status);
 };
 
-Torrent::Torrent(std::shared_ptr<libtorrent::session> session, const std::string& input)
-    : session(std::move(session)) {
-    try {
-        ensureResumeDirectory();
-        loadResumeData(input);
-        addTorrent(input);
-        downloadThread = std::thread(&Torrent::download, this);
-    } catch (const std::exception& e) {
-        errorMessage = e.what();
+TorrentManager::~TorrentManager() {
+    cancelCreation = true;
+    for (auto& creator : creators) creator.thread.join();
+    if (session) {
+        session->pause();
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            for (auto& entry : torrents) {
+                if (!entry.handle.is_valid()) continue;
+                requestSave(entry, libtorrent::torrent_handle::save_info_dict | libtorrent::torrent_handle::flush_disk_cache);
+                entry.finalSave = true;
+                ++pendingSaves;
+            }
+            saved.wait_for(lock, kShutdownTimeout, [this]() { return pendingSaves == 0; });
+        }
+        {
+            std::lock_guard<std::mutex> lock(notifyMtx);
+            stopping = true;
+        }
+        wake.notify_all();
+        alertThread.join();
+        session->set_alert_notify([]() {});
+        if (writeAtomically(SESSION_STATE_FILE, libtorrent::write_session_params_buf(session->session_state(SESSION_STATE_FLAGS), SESSION_STATE_FLAGS))) {
+            syncResumeDirectory();
+        }
+        session.reset();
     }
+    close(updateFd);
 }
 
-bool Torrent::verifyTorrent(const std::string& input) {
+bool TorrentManager::verifyTorrent(const std::string& input) {
     if (std::filesystem::exists(input)) {
         try {
             libtorrent::torrent_info ti(input);
@@ -94,112 +276,679 @@ bool Torrent::verifyTorrent(const std::string& input) {
     return false;
 }
 
-Torrent::~Torrent() {
-    stopFlag = true;
-    if (downloadThread.joinable()) {
-        downloadThread.join();
-    }
+void TorrentManager::startSession() {
+    ensureResumeDirectory();
+    profiles.load(TORRENT_CONFIG);
+    TorrentProfile profile = profiles.build(profiles.getSelected());
+    libtorrent::session_params params;
+    stats.warmStart = loadSessionState(params);
+    params.disk_io_constructor = profile.mmapDisk ? libtorrent::mmap_disk_io_constructor : libtorrent::posix_disk_io_constructor;
+    stats.configError = profiles.getLastError();
+    session = std::make_unique<libtorrent::session>(std::move(params));
+    applyProfile(profile.name);
+    session->set_alert_notify([this]() {
+        {
+            std::lock_guard<std::mutex> lock(notifyMtx);
+            alertsPending = true;
+        }
+        wake.notify_one();
+    });
+    alertThread = std::thread(&TorrentManager::alertLoop, this);
 }
 
-void Torrent::addTorrent(const std::string& input) {
+bool TorrentManager::addTorrent(const std::string& input, uint64_t& id) {
     libtorrent::add_torrent_params params;
-    if (std::filesystem::exists(input)) {
-        params.ti = std::make_shared<libtorrent::torrent_info>(input);
-        params.save_path = determineSavePath(input);
-    } else if (input.find("magnet:") == 0) {
-        libtorrent::error_code ec;
-        params = libtorrent::parse_magnet_uri(input, ec);
-        if (ec) throw std::runtime_error("Invalid magnet link: " + ec.message());
-        params.save_path = std::filesystem::current_path().string();
-    } else {
-        throw std::runtime_error("Invalid input: Must be a valid torrent file or magnet link");
+    std::string label;
+    try {
+        if (std::filesystem::exists(input)) {
+            params.ti = std::make_shared<libtorrent::torrent_info>(input);
+            params.save_path = determineSavePath(input);
+            label = std::filesystem::path(input).filename().string();
+        } else if (input.find("magnet:") == 0) {
+            libtorrent::error_code ec;
+            params = libtorrent::parse_magnet_uri(input, ec);
+            if (ec) throw std::runtime_error("Invalid magnet link: " + ec.message());
+            params.save_path = std::filesystem::current_path().string();
+            label = params.name;
+        } else {
+            throw std::runtime_error("Invalid input: Must be a valid torrent file or magnet link");
+        }
+    } catch (const std::exception& e) {
+        lastError = e.what();
+        return false;
     }
-    handle = session->add_torrent(std::move(params));
+
+    libtorrent::info_hash_t hashes = params.ti ? params.ti->info_hashes() : params.info_hashes;
+    libtorrent::add_torrent_params resumed;
+    if (loadResumeData(resumePath(resumeKey(hashes)), resumed)) {
+        if (!resumed.ti) resumed.ti = params.ti;
+        params = std::move(resumed);
+    }
+    libtorrent::torrent_handle handle;
+    return add(std::move(params), label, handle, id, lastError);
 }
 
-void Torrent::loadResumeData(const std::string& torrentFile) {
-    std::string resumePath = RESUME_DIR + std::filesystem::path(torrentFile).filename().string() + ".resume";
-    if (std::filesystem::exists(resumePath)) {
-        std::ifstream resumeFile(resumePath, std::ios::binary);
-        if (!resumeFile) {
-            std::cerr << "Failed to open resume file: " << resumePath << std::endl;
-            return;
+void TorrentManager::restore() {
+    std::error_code ec;
+    if (!std::filesystem::is_directory(RESUME_DIR, ec)) return;
+    for (const auto& file : std::filesystem::directory_iterator(RESUME_DIR, ec)) {
+        if (file.path().extension() != ".resume") continue;
+        libtorrent::add_torrent_params params;
+        if (!loadResumeData(file.path().string(), params)) continue;
+        std::string key = resumeKey(params.ti ? params.ti->info_hashes() : params.info_hashes);
+        libtorrent::torrent_handle handle;
+        uint64_t id;
+        std::string error;
+        if (!add(std::move(params), "", handle, id, error)) continue;
+        if (file.path().stem().string() != key) {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (Entry* entry = find(handle)) requestSave(*entry, libtorrent::torrent_handle::save_info_dict);
+            }
+            std::filesystem::remove(file.path(), ec);
         }
-        std::vector<char> buffer(std::istreambuf_iterator<char>(resumeFile), {});
+    }
+}
+
+bool TorrentManager::add(libtorrent::add_torrent_params params, const std::string& label, libtorrent::torrent_handle& handle,
+                         uint64_t& id, std::string& error) {
+    params.flags |= libtorrent::torrent_flags::update_subscribe;
+    std::string key = resumeKey(params.ti ? params.ti->info_hashes() : params.info_hashes);
+    int downloadLimit = std::max(params.download_limit, 0);
+    int uploadLimit = std::max(params.upload_limit, 0);
+    if (!session) startSession();
+    libtorrent::error_code ec;
+    handle = session->add_torrent(std::move(params), ec);
+    if (ec) {
+        error = ec.message();
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mtx);
+    if (find(handle)) {
+        error = "Torrent is already in the download list";
+        return false;
+    }
+    id = nextId++;
+    torrents.push_back({id, key, label.empty() ? key : label, handle, handle.status(), ""});
+    torrents.back().downloadLimit = downloadLimit;
+    torrents.back().uploadLimit = uploadLimit;
+    return true;
+}
+
+void TorrentManager::togglePause(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Entry* entry = find(id);
+    if (!entry) return;
+    if (entry->status.flags & libtorrent::torrent_flags::auto_managed) {
+        entry->handle.unset_flags(libtorrent::torrent_flags::auto_managed);
+        entry->handle.pause(libtorrent::torrent_handle::graceful_pause);
+        requestSave(*entry, libtorrent::torrent_handle::save_info_dict);
+    } else {
+        entry->handle.clear_error();
+        entry->handle.set_flags(libtorrent::torrent_flags::auto_managed);
+        entry->error.clear();
+    }
+}
+
+void TorrentManager::removeTorrent(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Entry* entry = find(id);
+    if (!entry) return;
+    session->remove_torrent(entry->handle);
+    std::error_code ec;
+    std::filesystem::remove(resumePath(entry->key), ec);
+    removedKeys.insert(entry->key);
+    std::erase_if(resumeBatch, [entry](const auto& item) { return item.first == entry->key; });
+    torrents.erase(torrents.begin() + (entry - torrents.data()));
+    signalUpdate();
+}
+
+void TorrentManager::moveInQueue(uint64_t id, bool up) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Entry* entry = find(id);
+    if (!entry) return;
+    if (up) {
+        entry->handle.queue_position_up();
+    } else {
+        entry->handle.queue_position_down();
+    }
+}
+
+std::vector<TorrentFileRow> TorrentManager::files(uint64_t id) {
+    libtorrent::torrent_handle handle;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        Entry* entry = find(id);
+        if (!entry) return {};
+        handle = entry->handle;
+    }
+    std::shared_ptr<const libtorrent::torrent_info> info = handle.torrent_file();
+    if (!info) return {};
+    const libtorrent::file_storage& storage = info->files();
+    std::vector<libtorrent::download_priority_t> priorities = handle.get_file_priorities();
+    std::vector<int64_t> progress = handle.file_progress(libtorrent::torrent_handle::piece_granularity);
+    std::vector<TorrentFileRow> rows;
+    for (int i = 0; i < storage.num_files(); ++i) {
+        libtorrent::file_index_t index(i);
+        if (storage.pad_file_at(index)) continue;
+        int priority = i < static_cast<int>(priorities.size()) ? static_cast<int>(static_cast<std::uint8_t>(priorities[i])) : kNormal;
+        rows.push_back({i, storage.file_path(index), storage.file_size(index),
+                        i < static_cast<int>(progress.size()) ? progress[i] : 0, priority});
+    }
+    return rows;
+}
+
+void TorrentManager::setFilePriority(uint64_t id, int index, int priority) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Entry* entry = find(id);
+    if (!entry) return;
+    entry->handle.file_priority(libtorrent::file_index_t(index), libtorrent::download_priority_t(static_cast<std::uint8_t>(priority)));
+}
+
+void TorrentManager::setLimits(uint64_t id, int downloadKiB, int uploadKiB) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Entry* entry = find(id);
+    if (!entry) return;
+    entry->downloadLimit = std::max(downloadKiB, 0) * 1024;
+    entry->uploadLimit = std::max(uploadKiB, 0) * 1024;
+    entry->handle.set_download_limit(entry->downloadLimit);
+    entry->handle.set_upload_limit(entry->uploadLimit);
+}
+
+void TorrentManager::toggleSequential(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Entry* entry = find(id);
+    if (!entry) return;
+    if (entry->status.flags & libtorrent::torrent_flags::sequential_download) {
+        entry->handle.unset_flags(libtorrent::torrent_flags::sequential_download);
+    } else {
+        entry->handle.set_flags(libtorrent::torrent_flags::sequential_download);
+    }
+}
+
+void TorrentManager::createTorrent(const std::string& path) {
+    if (!session) startSession();
+    std::lock_guard<std::mutex> lock(mtx);
+    creating.erase(std::remove_if(creating.begin(), creating.end(), [](const Creation& creation) {
+        return !creation.error.empty();
+    }), creating.end());
+    uint64_t id = nextId++;
+    creating.push_back({id, std::filesystem::path(path).filename().string(), 0, 0, ""});
+    creators.erase(std::remove_if(creators.begin(), creators.end(), [](Creator& creator) {
+        if (!*creator.done) return false;
+        creator.thread.join();
+        return true;
+    }), creators.end());
+    auto done = std::make_shared<std::atomic<bool>>(false);
+    creators.push_back({std::thread([this, id, path, done]() {
+        runCreation(id, path);
+        *done = true;
+    }), done});
+}
+
+std::vector<TorrentCreationRow> TorrentManager::creations() {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::vector<TorrentCreationRow> rows;
+    for (const auto& creation : creating) {
+        rows.push_back({creation.name, creation.piecesDone, creation.pieces, creation.error});
+    }
+    return rows;
+}
+
+void TorrentManager::updateCreation(uint64_t id, const std::function<void(Creation&)>& update) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = std::find_if(creating.begin(), creating.end(), [id](const Creation& creation) { return creation.id == id; });
+        if (it == creating.end()) return;
+        update(*it);
+    }
+    signalUpdate();
+}
+
+void TorrentManager::runCreation(uint64_t id, const std::string& path) {
+    std::filesystem::path source = std::filesystem::absolute(path).lexically_normal();
+    std::string root = source.parent_path().string();
+    std::string torrentFile = source.string() + ".torrent";
+    try {
+        libtorrent::file_storage files;
+        libtorrent::add_files(files, source.string());
+        if (files.num_files() == 0) throw std::runtime_error("Nothing to share in " + source.filename().string());
+        libtorrent::create_torrent creator(files, pieceSizeFor(files.total_size()));
+        creator.set_creator("Smart-Terminal");
+        int pieces = creator.num_pieces();
+        updateCreation(id, [pieces](Creation& creation) { creation.pieces = pieces; });
+
+        libtorrent::settings_pack hashing;
+        int threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        hashing.set_int(libtorrent::settings_pack::hashing_threads, threads);
+        hashing.set_int(libtorrent::settings_pack::aio_threads, threads);
+        int done = 0, shown = 0;
         libtorrent::error_code ec;
-        auto optionalParams = libtorrent::read_resume_data(buffer, ec);
-        if (ec) {
-            std::cerr << "Failed to load resume data: " << ec.message() << std::endl;
-            return;
-        } else {
-            handle = session->add_torrent(std::move(optionalParams));
+        libtorrent::set_piece_hashes(creator, root, hashing, [&](libtorrent::piece_index_t) {
+            if (cancelCreation) throw CreationCancelled();
+            ++done;
+            if (done * 100 / pieces == shown * 100 / pieces && done != pieces) return;
+            shown = done;
+            updateCreation(id, [done](Creation& creation) { creation.piecesDone = done; });
+        }, ec);
+        if (ec) throw std::runtime_error(ec.message());
+
+        std::vector<char> encoded;
+        libtorrent::bencode(std::back_inserter(encoded), creator.generate());
+        if (!writeAtomically(torrentFile, encoded)) throw std::runtime_error("Could not write " + torrentFile);
+
+        libtorrent::add_torrent_params params;
+        params.ti = std::make_shared<libtorrent::torrent_info>(encoded, ec, libtorrent::from_span);
+        if (ec) throw std::runtime_error(ec.message());
+        params.save_path = root;
+        params.flags |= libtorrent::torrent_flags::seed_mode;
+        libtorrent::torrent_handle handle;
+        uint64_t added;
+        std::string error;
+        if (!add(std::move(params), source.filename().string(), handle, added, error)) throw std::runtime_error(error);
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            creating.erase(std::remove_if(creating.begin(), creating.end(), [id](const Creation& creation) {
+                return creation.id == id;
+            }), creating.end());
         }
+        signalUpdate();
+    } catch (const CreationCancelled&) {
+    } catch (const std::exception& e) {
+        std::string message = e.what();
+        updateCreation(id, [&message](Creation& creation) { creation.error = message; });
+    }
+}
+
+int TorrentManager::pieceSizeFor(int64_t totalSize) {
+    int pieceSize = kMinPieceSize;
+    while (pieceSize < kMaxPieceSize && totalSize / pieceSize > kTargetPieces) pieceSize *= 2;
+    return pieceSize;
+}
+
+std::vector<TorrentRow> TorrentManager::snapshot() {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::vector<TorrentRow> rows;
+    for (const auto& entry : torrents) {
+        const libtorrent::torrent_status& status = entry.status;
+        int64_t remaining = status.total_wanted - status.total_wanted_done;
+        int64_t eta = status.download_payload_rate > 0 ? remaining / status.download_payload_rate : -1;
+        std::string error = entry.error.empty() && status.errc ? status.errc.message() : entry.error;
+        rows.push_back({entry.id, status.name.empty() ? entry.label : status.name, stateName(status), error,
+                        status.progress * 100, status.download_payload_rate, status.upload_payload_rate,
+                        status.num_peers, status.num_seeds, static_cast<int>(status.queue_position),
+                        status.is_finished ? 0 : eta, !(status.flags & libtorrent::torrent_flags::auto_managed),
+                        status.is_finished, entry.firstPeerSeconds, entry.fullRateSeconds, entry.peakRate,
+                        entry.downloadLimit, entry.uploadLimit,
+                        static_cast<bool>(status.flags & libtorrent::torrent_flags::sequential_download)});
     }
+    std::sort(rows.begin(), rows.end(), [](const TorrentRow& a, const TorrentRow& b) {
+        if (a.finished != b.finished) return !a.finished;
+        return a.queuePosition < b.queuePosition;
+    });
+    return rows;
 }
 
-std::string Torrent:: getTorrentName() const{
-    std::lock_guard<std::mutex> lock(statusMutex);
-    if (handle.is_valid() && handle.torrent_file()) {
-        return handle.torrent_file()->name();
+size_t TorrentManager::activeCount() {
+    std::lock_guard<std::mutex> lock(mtx);
+    size_t running = std::count_if(creating.begin(), creating.end(), [](const Creation& creation) { return creation.error.empty(); });
+    return running + std::count_if(torrents.begin(), torrents.end(), [](const Entry& entry) {
+        return !entry.status.is_finished && !(entry.status.flags & libtorrent::torrent_flags::paused);
+    });
+}
+
+void TorrentManager::setLiveUpdates(bool enabled) {
+    {
+        std::lock_guard<std::mutex> lock(notifyMtx);
+        live = enabled;
     }
-    return "Unknown";
+    wake.notify_one();
 }
 
-void Torrent::handleAlerts() {
+void TorrentManager::drainUpdates() {
+    uint64_t count;
+    while (read(updateFd, &count, sizeof(count)) > 0) {}
+}
+
+void TorrentManager::signalUpdate() {
+    uint64_t one = 1;
+    write(updateFd, &one, sizeof(one));
+}
+
+void TorrentManager::alertLoop() {
+    auto nextUpdate = std::chrono::steady_clock::now();
+    auto nextCheckpoint = nextUpdate + kCheckpointInterval;
     std::vector<libtorrent::alert*> alerts;
-    session->pop_alerts(&alerts);
-    for (auto* alert : alerts) {
-        if (auto* err = dynamic_cast<libtorrent::torrent_error_alert*>(alert)) {
-            errorMessage = err->message();
-        } else if (auto* saveAlert = dynamic_cast<libtorrent::save_resume_data_alert*>(alert)) {
-            std::ofstream resumeFile(RESUME_DIR + saveAlert->handle.torrent_file()->name() + ".resume", std::ios::binary);
-            auto buffer = libtorrent::write_resume_data_buf(saveAlert->params);
-            resumeFile.write(buffer.data(), buffer.size());
+    std::vector<std::pair<std::string, libtorrent::add_torrent_params>> batch;
+    while (true) {
+        bool checkpoint = false;
+        bool post = false;
+        bool answered = false;
+        {
+            std::unique_lock<std::mutex> lock(notifyMtx);
+            wake.wait_until(lock, nextUpdate, [this]() { return stopping || alertsPending; });
+            if (stopping) return;
+            alertsPending = false;
+            auto now = std::chrono::steady_clock::now();
+            auto interval = live ? std::chrono::duration_cast<std::chrono::steady_clock::duration>(kLiveUpdateInterval)
+                                 : std::chrono::duration_cast<std::chrono::steady_clock::duration>(kIdleUpdateInterval);
+            if (now >= nextUpdate) {
+                post = true;
+                nextUpdate = now + interval;
+            } else {
+                nextUpdate = std::min(nextUpdate, now + interval);
+            }
+            if (now >= nextCheckpoint) {
+                checkpoint = true;
+                nextCheckpoint = now + kCheckpointInterval;
+            }
+        }
+        if (post) {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (!torrents.empty()) {
+                session->post_torrent_updates();
+                session->post_session_stats();
+            }
         }
+        session->pop_alerts(&alerts);
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            for (auto* alert : alerts) dispatch(alert);
+            applySchedule(false);
+            if (checkpoint) requestCheckpoint();
+            batch.swap(resumeBatch);
+            removedKeys.clear();
+            answered = answeredSaves > 0;
+        }
+        if (!batch.empty()) writeResumeBatch(batch);
+        if (!batch.empty() || answered) finishSaves(batch);
+        batch.clear();
     }
 }
 
-std::string Torrent::determineSavePath(const std::string& torrentFile) {
-    std::filesystem::path path(torrentFile);
-    return path.has_parent_path() ? path.parent_path().string() : std::filesystem::current_path().string();
+void TorrentManager::dispatch(libtorrent::alert* alert) {
+    switch (alert->type()) {
+        case libtorrent::state_update_alert::alert_type:
+            onStateUpdate(*static_cast<libtorrent::state_update_alert*>(alert));
+            break;
+        case libtorrent::session_stats_alert::alert_type:
+            onSessionStats(*static_cast<libtorrent::session_stats_alert*>(alert));
+            break;
+        case libtorrent::torrent_error_alert::alert_type: {
+            auto* err = static_cast<libtorrent::torrent_error_alert*>(alert);
+            if (Entry* entry = find(err->handle)) entry->error = err->message();
+            signalUpdate();
+            break;
+        }
+        case libtorrent::torrent_finished_alert::alert_type:
+            if (Entry* entry = find(static_cast<libtorrent::torrent_finished_alert*>(alert)->handle)) {
+                requestSave(*entry, libtorrent::torrent_handle::save_info_dict);
+            }
+            break;
+        case libtorrent::save_resume_data_alert::alert_type: {
+            auto* resume = static_cast<libtorrent::save_resume_data_alert*>(alert);
+            if (Entry* entry = find(resume->handle)) resumeBatch.emplace_back(entry->key, resume->params);
+            answerSave(resume->handle);
+            break;
+        }
+        case libtorrent::metadata_received_alert::alert_type: {
+            const auto& handle = static_cast<libtorrent::metadata_received_alert*>(alert)->handle;
+            if (Entry* entry = find(handle)) {
+                std::string key = resumeKey(handle.info_hashes());
+                if (key != entry->key) {
+                    std::error_code ec;
+                    std::filesystem::remove(resumePath(entry->key), ec);
+                    entry->key = key;
+                }
+                requestSave(*entry, libtorrent::torrent_handle::save_info_dict);
+            }
+            break;
+        }
+        case libtorrent::save_resume_data_failed_alert::alert_type:
+            answerSave(static_cast<libtorrent::save_resume_data_failed_alert*>(alert)->handle);
+            break;
+        default:
+            break;
+    }
 }
 
-void Torrent::download() {
-    while (!completed && !stopFlag) {
-        auto [currentProgress, currentPeers, currentSpeed] = getTorrentStatus();
-        {
-            std::lock_guard<std::mutex> lock(statusMutex);
-            progress = currentProgress;
-            peers = currentPeers;
-            speed = currentSpeed;
-            completed = (progress >= 100.0f);
-        }
-        if (completed) {
-            saveResumeData();
-            break;
+void TorrentManager::onStateUpdate(const libtorrent::state_update_alert& update) {
+    bool changed = false;
+    for (const auto& status : update.status) {
+        if (Entry* entry = find(status.handle)) {
+            entry->status = status;
+            trackStartup(*entry);
+            changed = true;
+        }
+    }
+    if (changed) signalUpdate();
+}
+
+void TorrentManager::onSessionStats(const libtorrent::session_stats_alert& update) {
+    static const char* const names[] = {"net.recv_payload_bytes", "net.sent_payload_bytes", "dht.dht_nodes", "peer.num_peers_connected",
+                                        "peer.num_peers_up_unchoked", "disk.queued_disk_jobs", "disk.queued_write_bytes",
+                                        "disk.num_blocks_hashed", "disk.disk_read_time", "disk.disk_write_time",
+                                        "disk.disk_hash_time"};
+    static const std::vector<int> indices = []() {
+        std::vector<int> found;
+        for (const char* name : names) found.push_back(libtorrent::find_metric_idx(name));
+        return found;
+    }();
+    auto counters = update.counters();
+    std::vector<int64_t> values;
+    for (int index : indices) values.push_back(index >= 0 ? counters[index] : 0);
+    auto now = std::chrono::steady_clock::now();
+    if (!lastCounters.empty()) {
+        double seconds = std::chrono::duration<double>(now - lastCountersAt).count();
+        if (seconds > 0) {
+            stats.downloadRate = (values[0] - lastCounters[0]) / seconds;
+            stats.uploadRate = (values[1] - lastCounters[1]) / seconds;
         }
-        std::this_thread::sleep_for(std::chrono::seconds(2));
     }
+    stats.dhtNodes = values[2];
+    stats.peers = values[3];
+    stats.unchoked = values[4];
+    stats.diskJobs = values[5];
+    stats.diskQueuedBytes = values[6];
+    stats.blocksHashed = values[7];
+    stats.readSeconds = values[8] / 1e6;
+    stats.writeSeconds = values[9] / 1e6;
+    stats.hashSeconds = values[10] / 1e6;
+    lastCounters = values;
+    lastCountersAt = now;
 }
 
-void Torrent::saveResumeData() {
-    handle.save_resume_data();
+TorrentSessionStats TorrentManager::sessionStats() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return stats;
 }
 
-std::tuple<float, int, float> Torrent::getTorrentStatus() {
-    std::lock_guard<std::mutex> lock(statusMutex);
-    auto status = handle.status();
-    return {status.progress * 100, status.num_peers, static_cast<float>(status.download_rate) / 1000.0f};
+void TorrentManager::cycleProfile() {
+    if (!session) return;
+    std::lock_guard<std::mutex> lock(mtx);
+    applyProfile(profiles.next(stats.profile));
+}
+
+void TorrentManager::applyProfile(const std::string& name) {
+    TorrentProfile profile = profiles.build(name);
+    profile.settings.set_int(libtorrent::settings_pack::alert_mask, libtorrent::alert_category::status | libtorrent::alert_category::error | libtorrent::alert_category::storage);
+    session->apply_settings(profile.settings);
+    stats.profile = profile.name;
+    applySchedule(true);
+}
+
+void TorrentManager::applySchedule(bool force) {
+    time_t now = time(nullptr);
+    struct tm local;
+    localtime_r(&now, &local);
+    int window = profiles.activeWindow(local.tm_hour * 60 + local.tm_min);
+    if (window == scheduleWindow && !force) return;
+    scheduleWindow = window;
+    libtorrent::settings_pack limits;
+    if (window >= 0) {
+        const BandwidthWindow& active = profiles.getSchedule()[window];
+        limits.set_int(libtorrent::settings_pack::download_rate_limit, active.downloadKiB * 1024);
+        limits.set_int(libtorrent::settings_pack::upload_rate_limit, active.uploadKiB * 1024);
+        char text[64];
+        snprintf(text, sizeof(text), "%02d:%02d-%02d:%02d %d/%d KiB/s", active.start / 60, active.start % 60,
+                 active.end / 60, active.end % 60, active.downloadKiB, active.uploadKiB);
+        stats.schedule = text;
+    } else {
+        libtorrent::settings_pack profile = profiles.build(stats.profile).settings;
+        limits.set_int(libtorrent::settings_pack::download_rate_limit, profile.get_int(libtorrent::settings_pack::download_rate_limit));
+        limits.set_int(libtorrent::settings_pack::upload_rate_limit, profile.get_int(libtorrent::settings_pack::upload_rate_limit));
+        stats.schedule = profiles.getSchedule().empty() ? "" : "off-peak";
+    }
+    session->apply_settings(limits);
+}
+
+void TorrentManager::requestCheckpoint() {
+    for (auto& entry : torrents) {
+        if (entry.handle.is_valid() && entry.status.need_save_resume) {
+            requestSave(entry, libtorrent::torrent_handle::save_info_dict | libtorrent::torrent_handle::only_if_modified);
+        }
+    }
 }
 
-void Torrent::stopDownload() {
-    handle.pause();
-    saveResumeData();
+void TorrentManager::requestSave(Entry& entry, libtorrent::resume_data_flags_t flags) {
+    entry.handle.save_resume_data(flags);
+    ++entry.outstandingSaves;
 }
 
-void configureSession(std::shared_ptr<libtorrent::session>& session) {
-    libtorrent::settings_pack settings;
-    settings.set_int(libtorrent::settings_pack::alert_mask, libtorrent::alert::status_notification | libtorrent::alert::error_notification);
-    session->apply_settings(settings);
+void TorrentManager::answerSave(const libtorrent::torrent_handle& handle) {
+    Entry* entry = find(handle);
+    if (!entry || entry->outstandingSaves == 0 || --entry->outstandingSaves > 0 || !entry->finalSave) return;
+    entry->finalSave = false;
+    ++answeredSaves;
+}
+
+void TorrentManager::finishSaves(const std::vector<std::pair<std::string, libtorrent::add_torrent_params>>& batch) {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (const auto& item : batch) {
+        std::error_code ec;
+        if (removedKeys.count(item.first)) std::filesystem::remove(resumePath(item.first), ec);
+    }
+    pendingSaves -= std::min(pendingSaves, answeredSaves);
+    answeredSaves = 0;
+    if (pendingSaves == 0) saved.notify_all();
+}
+
+void TorrentManager::writeResumeBatch(const std::vector<std::pair<std::string, libtorrent::add_torrent_params>>& batch) {
+    for (const auto& [key, params] : batch) {
+        writeAtomically(resumePath(key), libtorrent::write_resume_data_buf(params));
+    }
+    syncResumeDirectory();
+}
+
+bool TorrentManager::writeAtomically(const std::string& path, const std::vector<char>& buffer) {
+    std::string temporary = path + ".tmp";
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    size_t written = 0;
+    while (written < buffer.size()) {
+        ssize_t n = write(fd, buffer.data() + written, buffer.size() - written);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        written += static_cast<size_t>(n);
+    }
+    bool ok = written == buffer.size() && fdatasync(fd) == 0;
+    close(fd);
+    if (ok && rename(temporary.c_str(), path.c_str()) == 0) return true;
+    unlink(temporary.c_str());
+    return false;
+}
+
+void TorrentManager::syncResumeDirectory() {
+    int dir = open(RESUME_DIR.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir >= 0) {
+        fsync(dir);
+        close(dir);
+    }
+}
+
+bool TorrentManager::loadSessionState(libtorrent::session_params& params) {
+    std::ifstream stateFile(SESSION_STATE_FILE, std::ios::binary);
+    if (!stateFile) return false;
+    std::vector<char> buffer(std::istreambuf_iterator<char>(stateFile), {});
+    try {
+        params = libtorrent::read_session_params(buffer, SESSION_STATE_FLAGS);
+    } catch (const std::exception& e) {
+        params = libtorrent::session_params();
+        return false;
+    }
+    return true;
+}
+
+void TorrentManager::trackStartup(Entry& entry) {
+    const libtorrent::torrent_status& status = entry.status;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - entry.addedAt).count();
+    if (entry.firstPeerSeconds < 0 && status.num_peers > 0) entry.firstPeerSeconds = seconds;
+    if (status.is_finished) return;
+    int rate = status.download_payload_rate;
+    entry.peakRate = std::max(entry.peakRate, rate);
+    if (rate > 0 && entry.reachedRate < kFullRateFraction * entry.peakRate && rate >= kFullRateFraction * entry.peakRate) {
+        entry.fullRateSeconds = seconds;
+        entry.reachedRate = rate;
+    }
+}
+
+TorrentManager::Entry* TorrentManager::find(uint64_t id) {
+    for (auto& entry : torrents) {
+        if (entry.id == id) return &entry;
+    }
+    return nullptr;
+}
+
+TorrentManager::Entry* TorrentManager::find(const libtorrent::torrent_handle& handle) {
+    for (auto& entry : torrents) {
+        if (entry.handle == handle) return &entry;
+    }
+    return nullptr;
+}
+
+std::string TorrentManager::resumeKey(const libtorrent::info_hash_t& hashes) {
+    static const char digits[] = "0123456789abcdef";
+    libtorrent::sha1_hash best = hashes.get_best();
+    std::string key;
+    for (size_t i = 0; i < best.size(); ++i) {
+        unsigned char byte = static_cast<unsigned char>(best.data()[i]);
+        key += digits[byte >> 4];
+        key += digits[byte & 15];
+    }
+    return key;
+}
+
+std::string TorrentManager::resumePath(const std::string& key) {
+    return RESUME_DIR + key + ".resume";
+}
+
+bool TorrentManager::loadResumeData(const std::string& path, libtorrent::add_torrent_params& params) {
+    std::ifstream resumeFile(path, std::ios::binary);
+    if (!resumeFile) return false;
+    std::vector<char> buffer(std::istreambuf_iterator<char>(resumeFile), {});
+    libtorrent::error_code ec;
+    params = libtorrent::read_resume_data(buffer, ec);
+    return !ec;
+}
+
+std::string TorrentManager::determineSavePath(const std::string& torrentFile) {
+    std::filesystem::path path(torrentFile);
+    return path.has_parent_path() ? path.parent_path().string() : std::filesystem::current_path().string();
+}
+
+std::string TorrentManager::stateName(const libtorrent::torrent_status& status) {
+    if (status.errc) return "error";
+    if (status.flags & libtorrent::torrent_flags::paused) {
+        return (status.flags & libtorrent::torrent_flags::auto_managed) ? "queued" : "paused";
+    }
+    switch (status.state) {
+        case libtorrent::torrent_status::checking_files:
+        case libtorrent::torrent_status::checking_resume_data: return "checking";
+        case libtorrent::torrent_status::downloading_metadata: return "metadata";
+        case libtorrent::torrent_status::downloading: return "downloading";
+        case libtorrent::torrent_status::finished: return "finished";
+        case libtorrent::torrent_status::seeding: return "seeding";
+        default: return "unknown";
+    }
 }
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,247 @@
+#ifndef TORRENT_PROFILES_HPP
+#define TORRENT_PROFILES_HPP
+
+#include <libtorrent/session.hpp>
+#include <libtorrent/settings_pack.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+const std::string TORRENT_CONFIG = "./torrent.conf";
+
+struct BandwidthWindow {
+    int start;
+    int end;
+    int downloadKiB;
+    int uploadKiB;
+
+    bool contains(int minute) const {
+        return start <= end ? minute >= start && minute < end : minute >= start || minute < end;
+    }
+};
+
+struct TorrentProfile {
+    std::string name;
+    libtorrent::settings_pack settings;
+    bool mmapDisk = true;
+};
+
+class TorrentProfiles {
+public:
+    TorrentProfiles() : order({"desktop", "seedbox", "low-memory"}) {}
+
+    bool load(const std::string& path) {
+        std::ifstream config(path);
+        if (!config) return true;
+        std::string line, section;
+        int number = 0;
+        while (std::getline(config, line)) {
+            ++number;
+            line = trim(line.substr(0, line.find('#')));
+            if (line.empty()) continue;
+            if (line.front() == '[' && line.back() == ']') {
+                section = trim(line.substr(1, line.size() - 2));
+                if (section != "schedule" && std::find(order.begin(), order.end(), section) == order.end()) order.push_back(section);
+                continue;
+            }
+            size_t equals = line.find('=');
+            if (equals == std::string::npos) {
+                lastError = path + ":" + std::to_string(number) + ": expected key = value";
+                continue;
+            }
+            std::string key = trim(line.substr(0, equals));
+            std::string value = trim(line.substr(equals + 1));
+            if (section.empty() && key == "profile") {
+                selected = value;
+                continue;
+            }
+            if (section == "schedule") {
+                BandwidthWindow window;
+                if (!parseWindow(key, value, window)) {
+                    lastError = path + ":" + std::to_string(number) + ": expected HH:MM-HH:MM = down/up KiB/s";
+                } else {
+                    schedule.push_back(window);
+                }
+                continue;
+            }
+            libtorrent::settings_pack probe;
+            bool mmap = true;
+            std::string error;
+            if (section.empty() || !apply(probe, mmap, key, value, error)) {
+                lastError = path + ":" + std::to_string(number) + ": " + (section.empty() ? "setting outside a [profile] section" : error);
+                continue;
+            }
+            overrides[section].push_back({key, value});
+        }
+        if (std::find(order.begin(), order.end(), selected) == order.end()) {
+            lastError = path + ": unknown profile '" + selected + "', using desktop";
+            selected = "desktop";
+        }
+        return lastError.empty();
+    }
+
+    TorrentProfile build(const std::string& name) const {
+        TorrentProfile profile{name, base(name), name != "low-memory"};
+        auto custom = overrides.find(name);
+        if (custom != overrides.end()) {
+            std::string error;
+            for (const auto& [key, value] : custom->second) apply(profile.settings, profile.mmapDisk, key, value, error);
+        }
+        return profile;
+    }
+
+    std::string next(const std::string& current) const {
+        auto it = std::find(order.begin(), order.end(), current);
+        if (it == order.end() || ++it == order.end()) return order.front();
+        return *it;
+    }
+
+    int activeWindow(int minute) const {
+        for (size_t i = 0; i < schedule.size(); ++i) {
+            if (schedule[i].contains(minute)) return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    const std::vector<BandwidthWindow>& getSchedule() const { return schedule; }
+    const std::string& getSelected() const { return selected; }
+    const std::string& getLastError() const { return lastError; }
+
+private:
+    std::vector<std::string> order;
+    std::map<std::string, std::vector<std::pair<std::string, std::string>>> overrides;
+    std::vector<BandwidthWindow> schedule;
+    std::string selected = "desktop";
+    std::string lastError;
+
+    static libtorrent::settings_pack base(const std::string& name) {
+        using sp = libtorrent::settings_pack;
+        sp pack = libtorrent::default_settings();
+        if (name == "seedbox") {
+            overlay(pack, libtorrent::high_performance_seed());
+            pack.set_int(sp::connections_limit, 8000);
+            pack.set_int(sp::active_downloads, 10);
+            pack.set_int(sp::active_seeds, 200);
+            pack.set_int(sp::active_limit, 210);
+            pack.set_int(sp::aio_threads, 16);
+            pack.set_int(sp::hashing_threads, 4);
+            pack.set_int(sp::send_buffer_watermark, 3 * 1024 * 1024);
+            pack.set_int(sp::send_buffer_low_watermark, 1024 * 1024);
+            pack.set_int(sp::send_buffer_watermark_factor, 150);
+            pack.set_int(sp::max_queued_disk_bytes, 32 * 1024 * 1024);
+            pack.set_int(sp::choking_algorithm, sp::rate_based_choker);
+            pack.set_int(sp::seed_choking_algorithm, sp::fastest_upload);
+        } else if (name == "low-memory") {
+            overlay(pack, libtorrent::min_memory_usage());
+            pack.set_int(sp::connections_limit, 50);
+            pack.set_int(sp::active_downloads, 2);
+            pack.set_int(sp::active_seeds, 2);
+            pack.set_int(sp::active_limit, 4);
+            pack.set_int(sp::aio_threads, 1);
+            pack.set_int(sp::hashing_threads, 1);
+            pack.set_int(sp::send_buffer_watermark, 64 * 1024);
+            pack.set_int(sp::send_buffer_low_watermark, 8 * 1024);
+            pack.set_int(sp::choking_algorithm, sp::fixed_slots_choker);
+            pack.set_int(sp::seed_choking_algorithm, sp::round_robin);
+        } else {
+            pack.set_int(sp::connections_limit, 200);
+            pack.set_int(sp::active_downloads, 3);
+            pack.set_int(sp::active_seeds, 5);
+            pack.set_int(sp::active_limit, 8);
+            pack.set_int(sp::aio_threads, 4);
+            pack.set_int(sp::hashing_threads, 2);
+            pack.set_int(sp::send_buffer_watermark, 512 * 1024);
+            pack.set_int(sp::send_buffer_low_watermark, 32 * 1024);
+            pack.set_int(sp::choking_algorithm, sp::fixed_slots_choker);
+            pack.set_int(sp::seed_choking_algorithm, sp::fastest_upload);
+        }
+        return pack;
+    }
+
+    static void overlay(libtorrent::settings_pack& pack, const libtorrent::settings_pack& delta) {
+        using sp = libtorrent::settings_pack;
+        for (int i = 0; i < sp::num_string_settings; ++i) {
+            if (delta.has_val(sp::string_type_base + i)) pack.set_str(sp::string_type_base + i, delta.get_str(sp::string_type_base + i));
+        }
+        for (int i = 0; i < sp::num_int_settings; ++i) {
+            if (delta.has_val(sp::int_type_base + i)) pack.set_int(sp::int_type_base + i, delta.get_int(sp::int_type_base + i));
+        }
+        for (int i = 0; i < sp::num_bool_settings; ++i) {
+            if (delta.has_val(sp::bool_type_base + i)) pack.set_bool(sp::bool_type_base + i, delta.get_bool(sp::bool_type_base + i));
+        }
+    }
+
+    static bool apply(libtorrent::settings_pack& pack, bool& mmapDisk, const std::string& key, const std::string& value,
+                      std::string& error) {
+        using sp = libtorrent::settings_pack;
+        if (key == "disk_io") {
+            if (value != "mmap" && value != "posix") {
+                error = "disk_io must be mmap or posix";
+                return false;
+            }
+            mmapDisk = value == "mmap";
+            return true;
+        }
+        int setting = libtorrent::setting_by_name(key);
+        if (setting < 0) {
+            error = "unknown setting '" + key + "'";
+            return false;
+        }
+        switch (setting & sp::type_mask) {
+            case sp::string_type_base:
+                pack.set_str(setting, value);
+                return true;
+            case sp::bool_type_base:
+                if (value == "true" || value == "yes" || value == "1") {
+                    pack.set_bool(setting, true);
+                } else if (value == "false" || value == "no" || value == "0") {
+                    pack.set_bool(setting, false);
+                } else {
+                    error = key + " expects true or false";
+                    return false;
+                }
+                return true;
+            default: {
+                static const std::map<std::string, int> symbols = {
+                    {"fixed_slots", sp::fixed_slots_choker}, {"rate_based", sp::rate_based_choker},
+                    {"round_robin", sp::round_robin}, {"fastest_upload", sp::fastest_upload}, {"anti_leech", sp::anti_leech}};
+                auto symbol = symbols.find(value);
+                if (symbol != symbols.end()) {
+                    pack.set_int(setting, symbol->second);
+                    return true;
+                }
+                char* end = nullptr;
+                long number = strtol(value.c_str(), &end, 10);
+                if (value.empty() || *end != '\0') {
+                    error = key + " expects a number";
+                    return false;
+                }
+                pack.set_int(setting, static_cast<int>(number));
+                return true;
+            }
+        }
+    }
+
+    static bool parseWindow(const std::string& key, const std::string& value, BandwidthWindow& window) {
+        int startHour, startMinute, endHour, endMinute;
+        if (sscanf(key.c_str(), "%d:%d-%d:%d", &startHour, &startMinute, &endHour, &endMinute) != 4) return false;
+        if (sscanf(value.c_str(), "%d/%d", &window.downloadKiB, &window.uploadKiB) != 2) return false;
+        if (startHour < 0 || startHour > 24 || endHour < 0 || endHour > 24 || startMinute < 0 || startMinute > 59 ||
+            endMinute < 0 || endMinute > 59 || window.downloadKiB < 0 || window.uploadKiB < 0) {
+            return false;
+        }
+        window.start = startHour * 60 + startMinute;
+        window.end = endHour * 60 + endMinute;
+        return true;
+    }
+
+    static std::string trim(const std::string& text) {
+        size_t first = text.find_first_not_of(" \t\r");
+        if (first == std::string::npos) return "";
+        return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+    }
+};
+#endif
@@ -0,0 +1,279 @@
+#ifndef TRANSFER_ENGINE_HPP
+#define TRANSFER_ENGINE_HPP
+
+#include <utility>
+#include <boost/asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "FileSharingServer.hpp"
+#include "FileSharingClient.hpp"
+#include "PeerDiscovery.hpp"
+
+struct TransferJobRow {
+    uint64_t id;
+    bool sending;
+    bool active;
+    std::string name;
+    std::string state;
+    std::string error;
+    uint64_t done;
+    uint64_t total;
+    double rate;
+    std::vector<std::string> details;
+};
+
+class TransferEngine {
+public:
+    static constexpr int kWorkers = 4;
+    static constexpr auto kConnectTimeout = std::chrono::seconds(10);
+    static constexpr auto kWaitTimeout = std::chrono::minutes(10);
+    static constexpr double kIdleTimeoutSeconds = 60;
+
+    TransferEngine() : work(boost::asio::make_work_guard(context)), pool(kWorkers) {
+        loop = std::thread([this]() { context.run(); });
+    }
+
+    ~TransferEngine() {
+        {
+            std::lock_guard<std::mutex> lock(jobsMutex);
+            for (auto& job : jobs) abort(job);
+        }
+        work.reset();
+        loop.join();
+        pool.join();
+    }
+
+    uint64_t send(const struct sockaddr_storage& address, socklen_t length, const std::string& path, bool delta) {
+        auto job = std::make_shared<Job>();
+        job->sending = true;
+        job->name = std::filesystem::path(path).filename().string();
+        job->client = std::make_shared<FileTransferClient>(address, length, path);
+        job->client->setDeltaMode(delta);
+        boost::asio::ip::tcp::endpoint endpoint;
+        std::memcpy(endpoint.data(), &address, length);
+        endpoint.resize(length);
+        add(job);
+        boost::asio::co_spawn(context, runSend(job, endpoint), settle(job));
+        return job->id;
+    }
+
+    uint64_t receive(std::unique_ptr<Server> server, const std::string& target) {
+        auto job = std::make_shared<Job>();
+        job->sending = false;
+        job->name = std::filesystem::path(target).filename().string();
+        if (job->name.empty()) job->name = "(sender's name)";
+        job->server = std::move(server);
+        job->state = Waiting;
+        add(job);
+        boost::asio::co_spawn(context, runReceive(job, target), settle(job));
+        return job->id;
+    }
+
+    void cancel(uint64_t id) {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        for (auto& job : jobs) {
+            if (job->id == id) abort(job);
+        }
+    }
+
+    void clearFinished() {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [](const std::shared_ptr<Job>& job) {
+            return job->finished();
+        }), jobs.end());
+    }
+
+    size_t activeCount() {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        return std::count_if(jobs.begin(), jobs.end(), [](const std::shared_ptr<Job>& job) { return !job->finished(); });
+    }
+
+    std::vector<TransferJobRow> snapshot() {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        std::vector<TransferJobRow> rows;
+        for (const auto& job : jobs) {
+            const TransferStats& stats = job->stats();
+            TransferJobRow row{job->id, job->sending, !job->finished(), job->name, stateName(job->state), "",
+                               stats.bytes, stats.expected, stats.rate(), stats.describe()};
+            if (job->finished()) {
+                std::lock_guard<std::mutex> errorLock(job->mtx);
+                row.error = job->error;
+                if (!job->receivedName.empty()) row.name = job->receivedName;
+            }
+            rows.push_back(row);
+        }
+        return rows;
+    }
+
+private:
+    enum State { Connecting, Waiting, Running, Done, Failed, Cancelled };
+
+    struct Job {
+        uint64_t id = 0;
+        bool sending = true;
+        std::string name;
+        std::atomic<State> state{Connecting};
+        std::shared_ptr<FileTransferClient> client;
+        std::shared_ptr<Server> server;
+        std::mutex mtx;
+        std::string error;
+        std::string receivedName;
+        std::function<void()> abortCurrent;
+        bool cancelled = false;
+        bool timedOut = false;
+
+        bool finished() const { return state == Done || state == Failed || state == Cancelled; }
+        const TransferStats& stats() const { return client ? client->getStats() : server->getStats(); }
+    };
+
+    boost::asio::io_context context;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work;
+    boost::asio::thread_pool pool;
+    std::thread loop;
+    std::mutex jobsMutex;
+    std::vector<std::shared_ptr<Job>> jobs;
+    uint64_t nextId = 1;
+
+    static std::string stateName(State state) {
+        switch (state) {
+            case Connecting: return "connecting";
+            case Waiting: return "waiting";
+            case Running: return "running";
+            case Done: return "done";
+            case Failed: return "failed";
+            case Cancelled: return "cancelled";
+        }
+        return "";
+    }
+
+    void add(const std::shared_ptr<Job>& job) {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        job->id = nextId++;
+        jobs.push_back(job);
+    }
+
+    void abort(const std::shared_ptr<Job>& job) {
+        boost::asio::post(context, [job]() {
+            job->cancelled = true;
+            if (job->abortCurrent) job->abortCurrent();
+        });
+    }
+
+    void finish(const std::shared_ptr<Job>& job, bool ok, const std::string& error) {
+        {
+            std::lock_guard<std::mutex> lock(job->mtx);
+            if (job->timedOut) {
+                job->error = "Timed out";
+            } else if (!ok && !job->cancelled) {
+                job->error = error;
+            }
+            if (job->server && !job->server->getReceivedPath().empty()) {
+                job->receivedName = std::filesystem::path(job->server->getReceivedPath()).filename().string();
+            }
+        }
+        job->abortCurrent = nullptr;
+        job->state = ok ? Done : (job->cancelled && !job->timedOut ? Cancelled : Failed);
+    }
+
+    std::function<void(std::exception_ptr)> settle(const std::shared_ptr<Job>& job) {
+        return [this, job](std::exception_ptr thrown) {
+            if (!thrown || job->finished()) return;
+            try {
+                std::rethrow_exception(thrown);
+            } catch (const std::exception& e) {
+                finish(job, false, e.what());
+            } catch (...) {
+                finish(job, false, "Unexpected error");
+            }
+        };
+    }
+
+    static void expire(const std::shared_ptr<Job>& job, boost::system::error_code ec) {
+        if (ec || job->state == Running || job->finished() || !job->abortCurrent) return;
+        job->timedOut = job->cancelled = true;
+        job->abortCurrent();
+    }
+
+    boost::asio::awaitable<bool> runBody(const std::shared_ptr<Job>& job, const std::function<bool()>& body) {
+        job->state = Running;
+        boost::asio::co_spawn(context, watchIdle(job), boost::asio::detached);
+        bool ok = co_await boost::asio::co_spawn(pool, callBody(body), boost::asio::use_awaitable);
+        co_return ok;
+    }
+
+    static boost::asio::awaitable<bool> callBody(const std::function<bool()>& body) {
+        co_return body();
+    }
+
+    boost::asio::awaitable<void> watchIdle(std::shared_ptr<Job> job) {
+        boost::asio::steady_timer timer(context);
+        while (job->state == Running) {
+            timer.expires_after(std::chrono::seconds(1));
+            co_await timer.async_wait(boost::asio::use_awaitable);
+            if (job->state == Running && !job->cancelled && job->stats().idleSeconds() > kIdleTimeoutSeconds) {
+                job->timedOut = job->cancelled = true;
+                if (job->abortCurrent) job->abortCurrent();
+            }
+        }
+    }
+
+    boost::asio::awaitable<void> runSend(std::shared_ptr<Job> job, boost::asio::ip::tcp::endpoint endpoint) {
+        boost::asio::ip::tcp::socket socket(context);
+        boost::asio::steady_timer deadline(context, kConnectTimeout);
+        deadline.async_wait([job](boost::system::error_code ec) { expire(job, ec); });
+        job->abortCurrent = [&socket]() { socket.close(); };
+        boost::system::error_code ec;
+        if (!job->cancelled) {
+            co_await socket.async_connect(endpoint, boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        }
+        deadline.cancel();
+        job->abortCurrent = nullptr;
+        if (job->cancelled || ec) {
+            finish(job, false, "Connection failed: " + ec.message());
+            co_return;
+        }
+
+        std::shared_ptr<FileTransferClient> client = job->client;
+        client->adoptSocket(socket.release());
+        job->abortCurrent = [client]() { client->cancel(); };
+        std::function<bool()> body = [client]() { return client->sendFile(); };
+        bool ok = co_await runBody(job, body);
+        finish(job, ok, client->getLastError());
+    }
+
+    boost::asio::awaitable<void> runReceive(std::shared_ptr<Job> job, std::string target) {
+        std::shared_ptr<Server> server = job->server;
+        PeerAnnouncer announcer(server->getPort(), NetworkUtils::hostName());
+        announcer.start();
+        boost::asio::posix::stream_descriptor listener(context, dup(server->getListenFd()));
+        boost::asio::steady_timer deadline(context, kWaitTimeout);
+        deadline.async_wait([job](boost::system::error_code ec) { expire(job, ec); });
+        job->abortCurrent = [&listener]() { listener.cancel(); };
+        boost::system::error_code ec;
+        if (!job->cancelled) {
+            co_await listener.async_wait(boost::asio::posix::stream_descriptor::wait_read,
+                                         boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        }
+        deadline.cancel();
+        job->abortCurrent = nullptr;
+        listener.close();
+        announcer.stop();
+        if (job->cancelled || ec || !server->acceptConnection(0)) {
+            finish(job, false, ec ? "Waiting for sender failed: " + ec.message() : server->getLastError());
+            co_return;
+        }
+
+        job->abortCurrent = [server]() { server->cancel(); };
+        std::function<bool()> body = [server, target]() { return server->receiveFile(target); };
+        bool ok = co_await runBody(job, body);
+        finish(job, ok, server->getLastError());
+    }
+};
+#endif
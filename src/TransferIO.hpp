@@ -0,0 +1,181 @@
+#ifndef TRANSFER_IO_HPP
+#define TRANSFER_IO_HPP
+
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <endian.h>
+#include <cerrno>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include "TransferStats.hpp"
+
+class TransferIO {
+public:
+    static constexpr int kSocketBufferSize = 8 << 20;
+    static constexpr size_t kPipeSize = 1 << 20;
+
+    static void tuneSocket(int sock) {
+        int size = kSocketBufferSize;
+        setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+
+    static bool writeAll(int fd, const void* data, size_t length) {
+        const char* cursor = static_cast<const char*>(data);
+        while (length > 0) {
+            SyscallTimer timer(TransferStats::Socket);
+            ssize_t sent = send(fd, cursor, length, MSG_NOSIGNAL);
+            if (sent < 0 && errno == ENOTSOCK) sent = write(fd, cursor, length);
+            timer.done(sent);
+            if (sent < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            cursor += sent;
+            length -= static_cast<size_t>(sent);
+        }
+        return true;
+    }
+
+    static bool readAll(int fd, void* data, size_t length) {
+        char* cursor = static_cast<char*>(data);
+        while (length > 0) {
+            SyscallTimer timer(TransferStats::Socket);
+            ssize_t got = timer.done(read(fd, cursor, length));
+            if (got < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            if (got == 0) return false;
+            cursor += got;
+            length -= static_cast<size_t>(got);
+        }
+        return true;
+    }
+
+    static bool pwriteAll(int fd, const void* data, size_t length, off_t offset) {
+        const char* cursor = static_cast<const char*>(data);
+        while (length > 0) {
+            SyscallTimer timer(TransferStats::Disk);
+            ssize_t written = timer.done(pwrite(fd, cursor, length, offset));
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            cursor += written;
+            offset += written;
+            length -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+
+    static bool writeU64(int fd, uint64_t value) {
+        uint64_t wire = htobe64(value);
+        return writeAll(fd, &wire, sizeof(wire));
+    }
+
+    static bool readU64(int fd, uint64_t& value) {
+        uint64_t wire;
+        if (!readAll(fd, &wire, sizeof(wire))) return false;
+        value = be64toh(wire);
+        return true;
+    }
+
+    static bool sendFileRange(int sock, int fd, off_t offset, uint64_t length) {
+        while (length > 0) {
+            size_t step = static_cast<size_t>(std::min<uint64_t>(length, 1ULL << 30));
+            SyscallTimer timer(TransferStats::Socket);
+            ssize_t sent = timer.done(sendfile(sock, fd, &offset, step));
+            if (sent < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EINVAL || errno == ENOSYS) return copyRange(sock, fd, offset, length);
+                return false;
+            }
+            if (sent == 0) return false;
+            length -= static_cast<uint64_t>(sent);
+        }
+        return true;
+    }
+
+    static uint64_t receiveToFile(int sock, int fd, off_t offset, uint64_t length) {
+        int pipeFds[2];
+        if (pipe2(pipeFds, O_CLOEXEC) != 0) return readToFile(sock, fd, offset, length);
+        fcntl(pipeFds[1], F_SETPIPE_SZ, static_cast<int>(kPipeSize));
+
+        uint64_t received = 0;
+        bool failed = false;
+        while (received < length && !failed) {
+            size_t step = static_cast<size_t>(std::min<uint64_t>(length - received, kPipeSize));
+            SyscallTimer timer(TransferStats::Socket);
+            ssize_t inPipe = timer.done(splice(sock, nullptr, pipeFds[1], nullptr, step, SPLICE_F_MOVE | SPLICE_F_MORE));
+            if (inPipe < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EINVAL && received == 0) {
+                    close(pipeFds[0]);
+                    close(pipeFds[1]);
+                    return readToFile(sock, fd, offset, length);
+                }
+                break;
+            }
+            if (inPipe == 0) break;
+            while (inPipe > 0) {
+                SyscallTimer diskTimer(TransferStats::Disk);
+                ssize_t written = diskTimer.done(splice(pipeFds[0], nullptr, fd, &offset, static_cast<size_t>(inPipe), SPLICE_F_MOVE));
+                if (written < 0) {
+                    if (errno == EINTR) continue;
+                    failed = true;
+                    break;
+                }
+                inPipe -= written;
+                received += static_cast<uint64_t>(written);
+            }
+        }
+        close(pipeFds[0]);
+        close(pipeFds[1]);
+        return received;
+    }
+
+    static void preallocate(int fd, uint64_t size) {
+        if (size == 0) return;
+        if (fallocate(fd, 0, 0, static_cast<off_t>(size)) != 0) {
+            posix_fallocate(fd, 0, static_cast<off_t>(size));
+        }
+    }
+
+private:
+    static bool copyRange(int sock, int fd, off_t offset, uint64_t length) {
+        std::vector<char> buffer(kPipeSize);
+        while (length > 0) {
+            size_t step = static_cast<size_t>(std::min<uint64_t>(length, buffer.size()));
+            SyscallTimer timer(TransferStats::Disk);
+            ssize_t got = timer.done(pread(fd, buffer.data(), step, offset));
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) return false;
+            if (!writeAll(sock, buffer.data(), static_cast<size_t>(got))) return false;
+            offset += got;
+            length -= static_cast<uint64_t>(got);
+        }
+        return true;
+    }
+
+    static uint64_t readToFile(int sock, int fd, off_t offset, uint64_t length) {
+        std::vector<char> buffer(kPipeSize);
+        uint64_t received = 0;
+        while (received < length) {
+            size_t step = static_cast<size_t>(std::min<uint64_t>(length - received, buffer.size()));
+            SyscallTimer timer(TransferStats::Socket);
+            ssize_t got = timer.done(read(sock, buffer.data(), step));
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) break;
+            if (!pwriteAll(fd, buffer.data(), static_cast<size_t>(got), offset)) break;
+            offset += got;
+            received += static_cast<uint64_t>(got);
+        }
+        return received;
+    }
+};
+#endif
@@ -0,0 +1,143 @@
+#ifndef TRANSFER_STATS_HPP
+#define TRANSFER_STATS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class TransferStats {
+public:
+    enum Channel { Socket, Disk };
+
+    std::atomic<uint64_t> expected{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> socketCalls{0};
+    std::atomic<uint64_t> socketBytes{0};
+    std::atomic<uint64_t> socketNanos{0};
+    std::atomic<uint64_t> diskCalls{0};
+    std::atomic<uint64_t> diskBytes{0};
+    std::atomic<uint64_t> diskNanos{0};
+
+    void begin(uint64_t total) {
+        expected = total;
+        bytes = socketCalls = socketBytes = socketNanos = 0;
+        diskCalls = diskBytes = diskNanos = 0;
+        startedAt = lastProgressAt = std::chrono::steady_clock::now().time_since_epoch().count();
+    }
+
+    void addProgress(uint64_t count) {
+        bytes += count;
+        lastProgressAt = std::chrono::steady_clock::now().time_since_epoch().count();
+    }
+
+    void record(Channel channel, int64_t transferred, uint64_t nanos) {
+        uint64_t moved = transferred > 0 ? static_cast<uint64_t>(transferred) : 0;
+        if (channel == Socket) {
+            ++socketCalls;
+            socketBytes += moved;
+            socketNanos += nanos;
+        } else {
+            ++diskCalls;
+            diskBytes += moved;
+            diskNanos += nanos;
+        }
+    }
+
+    double elapsedSeconds() const {
+        return (std::chrono::steady_clock::now().time_since_epoch().count() - startedAt) / 1e9;
+    }
+
+    double rate() const {
+        double seconds = elapsedSeconds();
+        return seconds > 0 ? bytes / seconds : 0.0;
+    }
+
+    double idleSeconds() const {
+        if (startedAt == 0) return 0.0;
+        return (std::chrono::steady_clock::now().time_since_epoch().count() - lastProgressAt) / 1e9;
+    }
+
+    bool stalled() const {
+        return idleSeconds() > kStallNanos / 1e9;
+    }
+
+    std::vector<std::string> describe() const {
+        char line[160];
+        std::vector<std::string> lines;
+        uint64_t done = bytes;
+        uint64_t total = expected;
+        double speed = rate();
+        double percent = total > 0 ? 100.0 * done / total : 100.0;
+        snprintf(line, sizeof(line), "%.1f / %.1f MiB  (%.1f%%)", done / 1048576.0, total / 1048576.0, percent);
+        lines.push_back(line);
+        if (stalled()) {
+            snprintf(line, sizeof(line), "%.1f MiB/s  STALLED", speed / 1048576.0);
+        } else if (speed > 0 && total > done) {
+            snprintf(line, sizeof(line), "%.1f MiB/s  ETA %.0fs", speed / 1048576.0, (total - done) / speed);
+        } else {
+            snprintf(line, sizeof(line), "%.1f MiB/s", speed / 1048576.0);
+        }
+        lines.push_back(line);
+        uint64_t calls = socketCalls;
+        snprintf(line, sizeof(line), "socket: %lu calls, avg %.1f KiB, %.2fs blocked",
+                 static_cast<unsigned long>(calls), calls ? socketBytes / 1024.0 / calls : 0.0, socketNanos / 1e9);
+        lines.push_back(line);
+        calls = diskCalls;
+        snprintf(line, sizeof(line), "disk:   %lu calls, avg %.1f KiB, %.2fs blocked",
+                 static_cast<unsigned long>(calls), calls ? diskBytes / 1024.0 / calls : 0.0, diskNanos / 1e9);
+        lines.push_back(line);
+        return lines;
+    }
+
+    static void reportProgress(uint64_t count) {
+        if (TransferStats* stats = current()) stats->addProgress(count);
+    }
+
+    static TransferStats*& current() {
+        thread_local TransferStats* stats = nullptr;
+        return stats;
+    }
+
+private:
+    static constexpr int64_t kStallNanos = 2000000000;
+    std::atomic<int64_t> startedAt{0};
+    std::atomic<int64_t> lastProgressAt{0};
+};
+
+class StatsScope {
+public:
+    StatsScope(TransferStats* stats) : previous(TransferStats::current()) {
+        TransferStats::current() = stats;
+    }
+
+    ~StatsScope() {
+        TransferStats::current() = previous;
+    }
+
+private:
+    TransferStats* previous;
+};
+
+class SyscallTimer {
+public:
+    SyscallTimer(TransferStats::Channel channel) : channel(channel), stats(TransferStats::current()) {
+        if (stats) started = std::chrono::steady_clock::now();
+    }
+
+    int64_t done(int64_t result) {
+        if (stats) {
+            auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started);
+            stats->record(channel, result, static_cast<uint64_t>(nanos.count()));
+        }
+        return result;
+    }
+
+private:
+    TransferStats::Channel channel;
+    TransferStats* stats;
+    std::chrono::steady_clock::time_point started;
+};
+#endif
@@ -0,0 +1,429 @@
+#ifndef TREE_TRANSFER_HPP
+#define TREE_TRANSFER_HPP
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "FileSharingProtocol.hpp"
+
+struct TreeEntry {
+    enum Type : uint8_t { End = 0, Directory = 1, File = 2, Symlink = 3 };
+    Type type;
+    std::string path;
+    uint32_t mode = 0;
+    int64_t mtimeSec = 0;
+    uint32_t mtimeNsec = 0;
+    uint64_t size = 0;
+};
+
+class TreeTransfer {
+public:
+    static constexpr uint64_t kSmallFileLimit = 256 << 10;
+    static constexpr size_t kBatchBytes = 4 << 20;
+    static constexpr size_t kReadAheadEntries = 512;
+    static constexpr uint64_t kReadAheadBytes = 64 << 20;
+
+    static std::vector<TreeEntry> scan(const std::string& root, uint64_t& totalBytes) {
+        std::vector<TreeEntry> entries;
+        totalBytes = 0;
+        scanDirectory(root, "", entries, totalBytes);
+        return entries;
+    }
+
+    static bool isSafePath(const std::string& path) {
+        if (path.empty() || path[0] == '/') return false;
+        size_t start = 0;
+        while (start <= path.size()) {
+            size_t end = path.find('/', start);
+            if (end == std::string::npos) end = path.size();
+            std::string part = path.substr(start, end - start);
+            if (part.empty() || part == "." || part == "..") return false;
+            start = end + 1;
+        }
+        return true;
+    }
+
+    static void putEntry(WireBuffer& buffer, const TreeEntry& entry) {
+        buffer.putU8(entry.type);
+        buffer.putString(entry.path);
+        buffer.putU32(entry.mode);
+        buffer.putU64(static_cast<uint64_t>(entry.mtimeSec));
+        buffer.putU32(entry.mtimeNsec);
+        buffer.putU64(entry.size);
+    }
+
+    static bool getEntry(WireReader& reader, TreeEntry& entry) {
+        uint8_t type;
+        uint64_t mtimeSec;
+        if (!reader.getU8(type)) return false;
+        entry.type = static_cast<TreeEntry::Type>(type);
+        if (entry.type == TreeEntry::End) return true;
+        if (!reader.getString(entry.path) || !reader.getU32(entry.mode) || !reader.getU64(mtimeSec) ||
+            !reader.getU32(entry.mtimeNsec) || !reader.getU64(entry.size)) {
+            return false;
+        }
+        entry.mtimeSec = static_cast<int64_t>(mtimeSec);
+        return true;
+    }
+
+private:
+    static void scanDirectory(const std::string& root, const std::string& relative, std::vector<TreeEntry>& entries, uint64_t& totalBytes) {
+        std::string path = relative.empty() ? root : root + "/" + relative;
+        DIR* dir = opendir(path.c_str());
+        if (!dir) return;
+        std::vector<std::string> names;
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            std::string name = entry->d_name;
+            if (name == "." || name == ".." || name == ".versions" || name == "RESUME_DATA") continue;
+            names.push_back(name);
+        }
+        closedir(dir);
+        std::sort(names.begin(), names.end());
+
+        for (const auto& name : names) {
+            std::string childRelative = relative.empty() ? name : relative + "/" + name;
+            struct stat st;
+            if (lstat((root + "/" + childRelative).c_str(), &st) != 0) continue;
+            TreeEntry item;
+            item.path = childRelative;
+            item.mode = st.st_mode & 07777;
+            item.mtimeSec = st.st_mtim.tv_sec;
+            item.mtimeNsec = static_cast<uint32_t>(st.st_mtim.tv_nsec);
+            if (S_ISDIR(st.st_mode)) {
+                item.type = TreeEntry::Directory;
+                entries.push_back(item);
+                scanDirectory(root, childRelative, entries, totalBytes);
+            } else if (S_ISREG(st.st_mode)) {
+                item.type = TreeEntry::File;
+                item.size = static_cast<uint64_t>(st.st_size);
+                totalBytes += item.size;
+                entries.push_back(item);
+            } else if (S_ISLNK(st.st_mode)) {
+                item.type = TreeEntry::Symlink;
+                item.size = static_cast<uint64_t>(st.st_size);
+                entries.push_back(item);
+            }
+        }
+    }
+};
+
+class TreeSender {
+public:
+    TreeSender(const std::string& root, std::vector<TreeEntry> entries)
+        : root(root), entries(std::move(entries)), contents(this->entries.size()), ready(this->entries.size(), 0) {}
+
+    bool send(int sock) {
+        unsigned readers = std::clamp(std::thread::hardware_concurrency(), 2u, 8u);
+        std::vector<std::thread> pool;
+        for (unsigned i = 0; i < readers; ++i) pool.emplace_back(&TreeSender::readAhead, this);
+
+        WireBuffer buffer;
+        bool ok = true;
+        for (size_t i = 0; i < entries.size() && ok; ++i) {
+            const TreeEntry& entry = entries[i];
+            if (entry.type == TreeEntry::File && entry.size > TreeTransfer::kSmallFileLimit) {
+                ok = buffer.flush(sock) && sendLargeFile(sock, entry, buffer);
+                TransferStats::reportProgress(entry.size);
+                continue;
+            }
+            std::string data;
+            if (entry.type != TreeEntry::Directory) {
+                data = take(i);
+            }
+            TreeEntry framed = entry;
+            framed.size = data.size();
+            TreeTransfer::putEntry(buffer, framed);
+            buffer.putBytes(data.data(), data.size());
+            if (buffer.size() >= TreeTransfer::kBatchBytes) ok = buffer.flush(sock);
+            TransferStats::reportProgress(data.size());
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (auto& thread : pool) thread.join();
+        if (!ok) return false;
+
+        TreeEntry end;
+        end.type = TreeEntry::End;
+        TreeTransfer::putEntry(buffer, end);
+        return buffer.flush(sock);
+    }
+
+private:
+    std::string root;
+    std::vector<TreeEntry> entries;
+    std::vector<std::string> contents;
+    std::vector<uint8_t> ready;
+    std::atomic<size_t> nextRead{0};
+    size_t consumed = 0;
+    uint64_t bufferedBytes = 0;
+    bool stopping = false;
+    std::mutex mtx;
+    std::condition_variable cv;
+
+    bool isPrefetched(const TreeEntry& entry) const {
+        return entry.type == TreeEntry::Symlink ||
+               (entry.type == TreeEntry::File && entry.size <= TreeTransfer::kSmallFileLimit);
+    }
+
+    void readAhead() {
+        while (true) {
+            size_t i = nextRead.fetch_add(1);
+            if (i >= entries.size()) return;
+            if (!isPrefetched(entries[i])) continue;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [&]() {
+                    return stopping || i == consumed ||
+                           (i < consumed + TreeTransfer::kReadAheadEntries && bufferedBytes < TreeTransfer::kReadAheadBytes);
+                });
+                if (stopping) return;
+            }
+            std::string data = load(entries[i]);
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                bufferedBytes += data.size();
+                contents[i] = std::move(data);
+                ready[i] = 1;
+            }
+            cv.notify_all();
+        }
+    }
+
+    std::string take(size_t i) {
+        std::unique_lock<std::mutex> lock(mtx);
+        consumed = i;
+        cv.notify_all();
+        cv.wait(lock, [&]() { return ready[i] != 0; });
+        std::string data = std::move(contents[i]);
+        bufferedBytes -= data.size();
+        consumed = i + 1;
+        lock.unlock();
+        cv.notify_all();
+        return data;
+    }
+
+    std::string load(const TreeEntry& entry) const {
+        std::string path = root + "/" + entry.path;
+        std::string data;
+        if (entry.type == TreeEntry::Symlink) {
+            data.resize(std::max<uint64_t>(entry.size, 1) + 1);
+            ssize_t length = readlink(path.c_str(), data.data(), data.size());
+            data.resize(length > 0 ? static_cast<size_t>(length) : 0);
+            return data;
+        }
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return data;
+        data.resize(entry.size);
+        size_t got = 0;
+        while (got < data.size()) {
+            ssize_t n = read(fd, data.data() + got, data.size() - got);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            got += static_cast<size_t>(n);
+        }
+        data.resize(got);
+        close(fd);
+        return data;
+    }
+
+    bool sendLargeFile(int sock, const TreeEntry& entry, WireBuffer& buffer) {
+        int fd = open((root + "/" + entry.path).c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        TreeEntry framed = entry;
+        framed.size = (fd >= 0 && fstat(fd, &st) == 0) ? std::min<uint64_t>(entry.size, st.st_size) : 0;
+        TreeTransfer::putEntry(buffer, framed);
+        bool ok = buffer.flush(sock);
+        if (fd >= 0) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            ok = ok && TransferIO::sendFileRange(sock, fd, 0, framed.size);
+            close(fd);
+        }
+        return ok;
+    }
+};
+
+class TreeReceiver {
+public:
+    TreeReceiver(const std::string& root) : root(root) {}
+
+    bool receive(int sock, uint64_t& filesWritten) {
+        unsigned writers = std::clamp(std::thread::hardware_concurrency(), 2u, 8u);
+        std::vector<std::thread> pool;
+        for (unsigned i = 0; i < writers; ++i) pool.emplace_back(&TreeReceiver::writeLoop, this);
+
+        mkdir(root.c_str(), 0755);
+        rootFd = open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        WireReader reader(sock);
+        std::vector<TreeEntry> directories;
+        bool ok = false;
+        TreeEntry entry;
+        while (TreeTransfer::getEntry(reader, entry)) {
+            if (entry.type == TreeEntry::End) {
+                ok = true;
+                break;
+            }
+            if (rootFd < 0 || !TreeTransfer::isSafePath(entry.path)) break;
+            if (entry.type == TreeEntry::Directory) {
+                std::string leaf;
+                int parent = openParent(entry.path, leaf);
+                if (parent < 0) break;
+                mkdirat(parent, leaf.c_str(), 0755);
+                close(parent);
+                directories.push_back(entry);
+            } else if (entry.size > TreeTransfer::kSmallFileLimit) {
+                if (entry.type != TreeEntry::File || !receiveLargeFile(sock, entry)) break;
+                TransferStats::reportProgress(entry.size);
+                ++filesWritten;
+            } else {
+                std::string data(entry.size, '\0');
+                if (entry.size > 0 && !reader.getBytes(data.data(), data.size())) break;
+                TransferStats::reportProgress(entry.size);
+                enqueue({entry, std::move(data)});
+                ++filesWritten;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            finished = true;
+        }
+        queueReady.notify_all();
+        for (auto& thread : pool) thread.join();
+
+        for (auto it = directories.rbegin(); it != directories.rend(); ++it) {
+            int fd = openDirectory(it->path);
+            if (fd < 0) continue;
+            fchmod(fd, it->mode & 0777);
+            applyTimes(fd, "", *it);
+            close(fd);
+        }
+        if (rootFd >= 0) close(rootFd);
+        rootFd = -1;
+        return ok && !writeFailed;
+    }
+
+private:
+    struct WriteJob {
+        TreeEntry entry;
+        std::string data;
+    };
+
+    static constexpr size_t kQueueLimit = 1024;
+    std::string root;
+    int rootFd = -1;
+    std::deque<WriteJob> queue;
+    bool finished = false;
+    std::atomic<bool> writeFailed{false};
+    std::mutex mtx;
+    std::condition_variable queueReady;
+    std::condition_variable queueSpace;
+
+    void enqueue(WriteJob job) {
+        std::unique_lock<std::mutex> lock(mtx);
+        queueSpace.wait(lock, [&]() { return queue.size() < kQueueLimit; });
+        queue.push_back(std::move(job));
+        lock.unlock();
+        queueReady.notify_one();
+    }
+
+    void writeLoop() {
+        while (true) {
+            std::unique_lock<std::mutex> lock(mtx);
+            queueReady.wait(lock, [&]() { return finished || !queue.empty(); });
+            if (queue.empty()) return;
+            WriteJob job = std::move(queue.front());
+            queue.pop_front();
+            lock.unlock();
+            queueSpace.notify_one();
+            if (!writeSmallFile(job)) writeFailed = true;
+        }
+    }
+
+    int openDirectory(const std::string& relative) const {
+        int fd = fcntl(rootFd, F_DUPFD_CLOEXEC, 0);
+        size_t start = 0;
+        while (fd >= 0 && start < relative.size()) {
+            size_t end = relative.find('/', start);
+            if (end == std::string::npos) end = relative.size();
+            int next = openat(fd, relative.substr(start, end - start).c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            close(fd);
+            fd = next;
+            start = end + 1;
+        }
+        return fd;
+    }
+
+    int openParent(const std::string& relative, std::string& leaf) const {
+        size_t slash = relative.rfind('/');
+        leaf = slash == std::string::npos ? relative : relative.substr(slash + 1);
+        return openDirectory(slash == std::string::npos ? "" : relative.substr(0, slash));
+    }
+
+    int createFile(const TreeEntry& entry) const {
+        std::string leaf;
+        int parent = openParent(entry.path, leaf);
+        if (parent < 0) return -1;
+        int fd = openat(parent, leaf.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOFOLLOW, 0600);
+        close(parent);
+        return fd;
+    }
+
+    bool writeSmallFile(const WriteJob& job) {
+        if (job.entry.type == TreeEntry::Symlink) {
+            std::string leaf;
+            int parent = openParent(job.entry.path, leaf);
+            if (parent < 0) return false;
+            unlinkat(parent, leaf.c_str(), 0);
+            bool ok = symlinkat(job.data.c_str(), parent, leaf.c_str()) == 0;
+            if (ok) applyTimes(parent, leaf, job.entry, AT_SYMLINK_NOFOLLOW);
+            close(parent);
+            return ok;
+        }
+        if (job.entry.type != TreeEntry::File) return false;
+        int fd = createFile(job.entry);
+        if (fd < 0) return false;
+        bool ok = TransferIO::pwriteAll(fd, job.data.data(), job.data.size(), 0);
+        fchmod(fd, job.entry.mode & 0777);
+        applyTimes(fd, "", job.entry);
+        close(fd);
+        return ok;
+    }
+
+    bool receiveLargeFile(int sock, const TreeEntry& entry) {
+        int fd = createFile(entry);
+        if (fd < 0) return false;
+        TransferIO::preallocate(fd, entry.size);
+        bool ok = TransferIO::receiveToFile(sock, fd, 0, entry.size) == entry.size;
+        fchmod(fd, entry.mode & 0777);
+        applyTimes(fd, "", entry);
+        close(fd);
+        return ok;
+    }
+
+    static void applyTimes(int fd, const std::string& path, const TreeEntry& entry, int flags = 0) {
+        struct timespec times[2];
+        times[0].tv_sec = entry.mtimeSec;
+        times[0].tv_nsec = entry.mtimeNsec;
+        times[1] = times[0];
+        if (path.empty()) {
+            futimens(fd, times);
+        } else {
+            utimensat(fd, path.c_str(), times, flags);
+        }
+    }
+};
+#endif
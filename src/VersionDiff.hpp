@@ -0,0 +1,431 @@
+#ifndef VERSION_DIFF_HPP
+#define VERSION_DIFF_HPP
+
+#include <ncurses.h>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+class LineHasher {
+public:
+    static uint64_t hash(const char* data, size_t length) {
+        uint64_t h = 0x9E3779B97F4A7C15ULL ^ (length * 0xC2B2AE3D27D4EB4FULL);
+        size_t i = 0;
+        for (; i + 32 <= length; i += 32) {
+            uint64_t w[4];
+            std::memcpy(w, data + i, 32);
+            h = mix(h ^ mix(w[0]) ^ rotate(mix(w[1]), 17) ^ rotate(mix(w[2]), 31) ^ rotate(mix(w[3]), 47));
+        }
+        for (; i + 8 <= length; i += 8) {
+            uint64_t w;
+            std::memcpy(&w, data + i, 8);
+            h = mix(h ^ w);
+        }
+        if (i < length) {
+            uint64_t w = 0;
+            std::memcpy(&w, data + i, length - i);
+            h = mix(h ^ w);
+        }
+        return h;
+    }
+
+    static uint64_t hash(const std::string& line) {
+        return hash(line.data(), line.size());
+    }
+
+private:
+    static uint64_t rotate(uint64_t v, int r) {
+        return (v << r) | (v >> (64 - r));
+    }
+
+    static uint64_t mix(uint64_t v) {
+        v ^= v >> 33;
+        v *= 0xFF51AFD7ED558CCDULL;
+        v ^= v >> 33;
+        v *= 0xC4CEB9FE1A85EC53ULL;
+        v ^= v >> 33;
+        return v;
+    }
+};
+
+struct DiffLine {
+    char tag;
+    int oldIndex;
+    int newIndex;
+};
+
+struct DiffHunk {
+    int oldStart, oldCount;
+    int newStart, newCount;
+    size_t firstLine;
+};
+
+class LineDiff {
+public:
+    LineDiff(const std::vector<std::string>& oldLines, const std::vector<std::string>& newLines, int context = 3)
+        : oldLines(oldLines), newLines(newLines), context(context) {}
+
+    void compute() {
+        internLines();
+        compareMatchable();
+        buildHunks();
+    }
+
+    const std::vector<DiffLine>& getLines() const { return lines; }
+    const std::vector<DiffHunk>& getHunks() const { return hunks; }
+    int getAdded() const { return addedCount; }
+    int getRemoved() const { return removedCount; }
+
+private:
+    const std::vector<std::string>& oldLines;
+    const std::vector<std::string>& newLines;
+    int context;
+    std::vector<int> a, b;
+    std::vector<int> oldMap, newMap;
+    std::vector<bool> removed, added;
+    std::vector<int> forward, backward;
+    std::vector<DiffLine> lines;
+    std::vector<DiffHunk> hunks;
+    int addedCount = 0;
+    int removedCount = 0;
+    int64_t costLeft = kCostBudget;
+    static constexpr int kCostLimit = 4096;
+    static constexpr int64_t kCostBudget = int64_t(1) << 26;
+
+    void internLines() {
+        struct Slot { uint32_t tag; int id; };
+        size_t capacity = 16;
+        while (capacity < 2 * (oldLines.size() + newLines.size())) capacity <<= 1;
+        std::vector<Slot> table(capacity, Slot{0, -1});
+        std::vector<const std::string*> representatives;
+        representatives.reserve(oldLines.size() + newLines.size());
+        auto idOf = [&](const std::string& line) {
+            uint64_t h = LineHasher::hash(line);
+            uint32_t tag = static_cast<uint32_t>(h >> 32);
+            size_t at = h & (capacity - 1);
+            while (table[at].id >= 0) {
+                if (table[at].tag == tag && *representatives[table[at].id] == line) return table[at].id;
+                at = (at + 1) & (capacity - 1);
+            }
+            int id = static_cast<int>(representatives.size());
+            representatives.push_back(&line);
+            table[at] = {tag, id};
+            return id;
+        };
+        a.resize(oldLines.size());
+        b.resize(newLines.size());
+        for (size_t i = 0; i < oldLines.size(); ++i) a[i] = idOf(oldLines[i]);
+        for (size_t i = 0; i < newLines.size(); ++i) b[i] = idOf(newLines[i]);
+
+        std::vector<uint8_t> seen(representatives.size(), 0);
+        for (int id : a) seen[id] |= 1;
+        for (int id : b) seen[id] |= 2;
+        for (size_t i = 0; i < a.size(); ++i) {
+            if (seen[a[i]] == 3) oldMap.push_back(static_cast<int>(i));
+        }
+        for (size_t i = 0; i < b.size(); ++i) {
+            if (seen[b[i]] == 3) newMap.push_back(static_cast<int>(i));
+        }
+    }
+
+    void compareMatchable() {
+        std::vector<int> fullA, fullB;
+        fullA.swap(a);
+        fullB.swap(b);
+        a.reserve(oldMap.size());
+        b.reserve(newMap.size());
+        for (int i : oldMap) a.push_back(fullA[i]);
+        for (int i : newMap) b.push_back(fullB[i]);
+
+        removed.assign(a.size(), false);
+        added.assign(b.size(), false);
+        size_t window = 2 * std::min<size_t>((a.size() + b.size() + 1) / 2, kCostLimit) + 3;
+        forward.assign(window, -1);
+        backward.assign(window, -1);
+        compareRange(0, static_cast<int>(a.size()), 0, static_cast<int>(b.size()));
+        forward.clear();
+        forward.shrink_to_fit();
+        backward.clear();
+        backward.shrink_to_fit();
+
+        std::vector<bool> fullRemoved(fullA.size(), true), fullAdded(fullB.size(), true);
+        for (size_t i = 0; i < oldMap.size(); ++i) fullRemoved[oldMap[i]] = removed[i];
+        for (size_t i = 0; i < newMap.size(); ++i) fullAdded[newMap[i]] = added[i];
+        removed.swap(fullRemoved);
+        added.swap(fullAdded);
+        a.swap(fullA);
+        b.swap(fullB);
+    }
+
+    void compareRange(int aLo, int aHi, int bLo, int bHi) {
+        while (aLo < aHi && bLo < bHi && a[aLo] == b[bLo]) { ++aLo; ++bLo; }
+        while (aLo < aHi && bLo < bHi && a[aHi - 1] == b[bHi - 1]) { --aHi; --bHi; }
+
+        if (aLo == aHi) {
+            for (int j = bLo; j < bHi; ++j) added[j] = true;
+            return;
+        }
+        if (bLo == bHi) {
+            for (int i = aLo; i < aHi; ++i) removed[i] = true;
+            return;
+        }
+
+        int x, y;
+        if (costLeft <= 0 || !findSplit(aLo, aHi, bLo, bHi, x, y)) {
+            for (int i = aLo; i < aHi; ++i) removed[i] = true;
+            for (int j = bLo; j < bHi; ++j) added[j] = true;
+            return;
+        }
+        compareRange(aLo, x, bLo, y);
+        compareRange(x, aHi, y, bHi);
+    }
+
+    bool findSplit(int aLo, int aHi, int bLo, int bHi, int& splitX, int& splitY) {
+        const int n = aHi - aLo;
+        const int m = bHi - bLo;
+        const int delta = n - m;
+        const bool front = (delta & 1) != 0;
+        const int maxD = (n + m + 1) / 2;
+        const int limit = std::min(maxD, kCostLimit);
+        const int offset = limit + 1;
+        const int length = 2 * limit + 3;
+        int* vf = forward.data();
+        int* vb = backward.data();
+        std::fill(vf, vf + length, -1);
+        std::fill(vb, vb + length, -1);
+        vf[offset + 1] = 0;
+        vb[offset + 1] = 0;
+
+        int fStart = 0, fEnd = 0, bStart = 0, bEnd = 0;
+        int bestX = -1, bestY = -1;
+        for (int d = 0; d < maxD; ++d) {
+            for (int k = -d + fStart; k <= d - fEnd; k += 2) {
+                int at = offset + k;
+                int x = (k == -d || (k != d && vf[at - 1] < vf[at + 1])) ? vf[at + 1] : vf[at - 1] + 1;
+                int y = x - k;
+                while (x < n && y < m && a[aLo + x] == b[bLo + y]) { ++x; ++y; }
+                vf[at] = x;
+                if (x > n) {
+                    fEnd += 2;
+                } else if (y > m) {
+                    fStart += 2;
+                } else {
+                    if (x + y > bestX + bestY) { bestX = x; bestY = y; }
+                    int back = offset + delta - k;
+                    if (front && back >= 0 && back < length && vb[back] != -1 && x >= n - vb[back]) {
+                        return acceptSplit(aLo, bLo, n, m, x, y, splitX, splitY);
+                    }
+                }
+            }
+            for (int k = -d + bStart; k <= d - bEnd; k += 2) {
+                int at = offset + k;
+                int x = (k == -d || (k != d && vb[at - 1] < vb[at + 1])) ? vb[at + 1] : vb[at - 1] + 1;
+                int y = x - k;
+                while (x < n && y < m && a[aHi - 1 - x] == b[bHi - 1 - y]) { ++x; ++y; }
+                vb[at] = x;
+                if (x > n) {
+                    bEnd += 2;
+                } else if (y > m) {
+                    bStart += 2;
+                } else if (!front) {
+                    int fwd = offset + delta - k;
+                    if (fwd >= 0 && fwd < length && vf[fwd] != -1) {
+                        int fx = vf[fwd];
+                        int fy = offset + fx - fwd;
+                        if (fx >= n - x) {
+                            return acceptSplit(aLo, bLo, n, m, fx, fy, splitX, splitY);
+                        }
+                    }
+                }
+            }
+            costLeft -= 2 * (d + 1);
+            if (d >= limit || costLeft <= 0) {
+                return acceptSplit(aLo, bLo, n, m, bestX, bestY, splitX, splitY);
+            }
+        }
+        return false;
+    }
+
+    static bool acceptSplit(int aLo, int bLo, int n, int m, int x, int y, int& splitX, int& splitY) {
+        if (x < 0 || y < 0 || x > n || y > m) return false;
+        if ((x == 0 && y == 0) || (x == n && y == m)) return false;
+        splitX = aLo + x;
+        splitY = bLo + y;
+        return true;
+    }
+
+    void buildHunks() {
+        struct Change { int oldPos, newPos, removed, added; };
+        const int n = static_cast<int>(a.size());
+        const int m = static_cast<int>(b.size());
+        std::vector<Change> changes;
+        int i = 0, j = 0;
+        while (i < n || j < m) {
+            if ((i < n && removed[i]) || (j < m && added[j])) {
+                Change change{i, j, 0, 0};
+                while ((i < n && removed[i]) || (j < m && added[j])) {
+                    if (i < n && removed[i]) { ++i; ++change.removed; }
+                    else { ++j; ++change.added; }
+                }
+                removedCount += change.removed;
+                addedCount += change.added;
+                changes.push_back(change);
+            } else if (i < n && j < m) {
+                ++i; ++j;
+            } else {
+                break;
+            }
+        }
+
+        size_t c = 0;
+        while (c < changes.size()) {
+            size_t last = c;
+            while (last + 1 < changes.size() &&
+                   changes[last + 1].oldPos - (changes[last].oldPos + changes[last].removed) <= 2 * context) {
+                ++last;
+            }
+            int oldStart = std::max(0, changes[c].oldPos - context);
+            int newStart = changes[c].newPos - (changes[c].oldPos - oldStart);
+            int lastOldEnd = changes[last].oldPos + changes[last].removed;
+            int lastNewEnd = changes[last].newPos + changes[last].added;
+            int trailing = std::min({context, n - lastOldEnd, m - lastNewEnd});
+
+            DiffHunk hunk{oldStart, lastOldEnd + trailing - oldStart, newStart, lastNewEnd + trailing - newStart, lines.size()};
+            int oi = oldStart, ni = newStart;
+            for (size_t k = c; k <= last; ++k) {
+                const Change& change = changes[k];
+                while (oi < change.oldPos) lines.push_back({' ', oi++, ni++});
+                for (int r = 0; r < change.removed; ++r) lines.push_back({'-', oi++, -1});
+                for (int r = 0; r < change.added; ++r) lines.push_back({'+', -1, ni++});
+            }
+            for (int r = 0; r < trailing; ++r) lines.push_back({' ', oi++, ni++});
+            hunks.push_back(hunk);
+            c = last + 1;
+        }
+    }
+};
+
+class DiffViewer {
+public:
+    DiffViewer(const std::string& oldTitle, const std::vector<std::string>& oldLines,
+               const std::string& newTitle, const std::vector<std::string>& newLines)
+        : oldTitle(oldTitle), newTitle(newTitle), oldLines(oldLines), newLines(newLines),
+          diff(oldLines, newLines) {
+        diff.compute();
+    }
+
+    void run() {
+        if (has_colors()) {
+            start_color();
+            use_default_colors();
+            init_pair(1, COLOR_GREEN, -1);
+            init_pair(2, COLOR_RED, -1);
+            init_pair(3, COLOR_CYAN, -1);
+        }
+        curs_set(0);
+        keypad(stdscr, TRUE);
+        buildRows();
+
+        int top = 0;
+        while (true) {
+            int pageHeight = std::max(1, LINES - 3);
+            int maxTop = std::max(0, static_cast<int>(rows.size()) - pageHeight);
+            top = std::clamp(top, 0, maxTop);
+            draw(top, pageHeight);
+
+            int ch = getch();
+            if (ch == 27 || ch == 'q') {
+                break;
+            } else if (ch == KEY_UP) {
+                --top;
+            } else if (ch == KEY_DOWN) {
+                ++top;
+            } else if (ch == KEY_PPAGE) {
+                top -= pageHeight;
+            } else if (ch == KEY_NPAGE || ch == ' ') {
+                top += pageHeight;
+            } else if (ch == KEY_HOME) {
+                top = 0;
+            } else if (ch == KEY_END) {
+                top = maxTop;
+            } else if (ch == 'n') {
+                auto it = std::upper_bound(hunkRows.begin(), hunkRows.end(), top);
+                if (it != hunkRows.end()) top = *it;
+            } else if (ch == 'p') {
+                auto it = std::lower_bound(hunkRows.begin(), hunkRows.end(), top);
+                if (it != hunkRows.begin()) top = *std::prev(it);
+            }
+        }
+        clear();
+    }
+
+private:
+    struct Row {
+        int hunk;
+        int line;
+    };
+
+    std::string oldTitle;
+    std::string newTitle;
+    const std::vector<std::string>& oldLines;
+    const std::vector<std::string>& newLines;
+    LineDiff diff;
+    std::vector<Row> rows;
+    std::vector<int> hunkRows;
+
+    void buildRows() {
+        const auto& hunks = diff.getHunks();
+        const auto& lines = diff.getLines();
+        rows.reserve(lines.size() + hunks.size());
+        for (size_t h = 0; h < hunks.size(); ++h) {
+            size_t end = (h + 1 < hunks.size()) ? hunks[h + 1].firstLine : lines.size();
+            hunkRows.push_back(static_cast<int>(rows.size()));
+            rows.push_back({static_cast<int>(h), -1});
+            for (size_t l = hunks[h].firstLine; l < end; ++l) {
+                rows.push_back({static_cast<int>(h), static_cast<int>(l)});
+            }
+        }
+    }
+
+    void draw(int top, int pageHeight) {
+        erase();
+        attron(A_BOLD);
+        mvprintw(0, 0, "--- %s", oldTitle.c_str());
+        mvprintw(1, 0, "+++ %s", newTitle.c_str());
+        attroff(A_BOLD);
+
+        if (rows.empty()) {
+            mvprintw(3, 0, "No differences.");
+        }
+        const auto& hunks = diff.getHunks();
+        const auto& lines = diff.getLines();
+        for (int i = 0; i < pageHeight && top + i < static_cast<int>(rows.size()); ++i) {
+            const Row& row = rows[top + i];
+            if (row.line < 0) {
+                const DiffHunk& hunk = hunks[row.hunk];
+                attron(COLOR_PAIR(3));
+                mvprintw(i + 2, 0, "@@ -%d,%d +%d,%d @@", hunk.oldStart + (hunk.oldCount ? 1 : 0), hunk.oldCount,
+                         hunk.newStart + (hunk.newCount ? 1 : 0), hunk.newCount);
+                attroff(COLOR_PAIR(3));
+                continue;
+            }
+            const DiffLine& line = lines[row.line];
+            const std::string& text = (line.tag == '+') ? newLines[line.newIndex] : oldLines[line.oldIndex];
+            int pair = (line.tag == '+') ? 1 : (line.tag == '-') ? 2 : 0;
+            if (pair) attron(COLOR_PAIR(pair));
+            mvaddch(i + 2, 0, line.tag);
+            addnstr(text.c_str(), std::max(0, COLS - 1));
+            if (pair) attroff(COLOR_PAIR(pair));
+        }
+
+        attron(A_REVERSE);
+        mvprintw(LINES - 1, 0, " +%d -%d | %zu hunks | n/p hunk  PgUp/PgDn  Home/End  Esc back ",
+                 diff.getAdded(), diff.getRemoved(), hunks.size());
+        attroff(A_REVERSE);
+        refresh();
+    }
+};
+#endif
@@ -9,6 +9,269 @@
 #include <iomanip>
 #include <ctime>
 #include <vector>
+#include <map>
+#include <set>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+
+struct RetentionPolicy {
+    int keepAllHours = 24;
+    int dailyDays = 30;
+    int monthlyMonths = 0;
+};
+
+struct CompactionResult {
+    size_t packed = 0;
+    size_t pruned = 0;
+    size_t inodesFreed = 0;
+    uintmax_t bytesBefore = 0;
+    uintmax_t bytesAfter = 0;
+    uintmax_t indexBytesBefore = 0;
+    uintmax_t indexBytesAfter = 0;
+};
+
+class VersionPack {
+public:
+    struct Entry {
+        std::string blobHash;
+        uint64_t offset = 0;
+        uint64_t size = 0;
+    };
+
+    VersionPack(const std::filesystem::path& versionsDir) : versionsDir(versionsDir) {
+        loadIndex();
+    }
+
+    bool contains(const std::string& fileHash, const std::string& timestamp) const {
+        auto it = entries.find(fileHash);
+        return it != entries.end() && it->second.count(timestamp);
+    }
+
+    std::vector<std::string> listVersions(const std::string& fileHash) const {
+        std::vector<std::string> timestamps;
+        auto it = entries.find(fileHash);
+        if (it == entries.end()) return timestamps;
+        for (const auto& [timestamp, entry] : it->second) {
+            timestamps.push_back(timestamp);
+        }
+        return timestamps;
+    }
+
+    bool read(const std::string& fileHash, const std::string& timestamp, std::string& content) const {
+        auto it = entries.find(fileHash);
+        if (it == entries.end()) return false;
+        auto version = it->second.find(timestamp);
+        if (version == it->second.end()) return false;
+        std::ifstream pack(versionsDir / packName, std::ios::binary);
+        if (!pack) return false;
+        content.resize(version->second.size);
+        pack.seekg(static_cast<std::streamoff>(version->second.offset));
+        return static_cast<bool>(pack.read(content.data(), static_cast<std::streamsize>(content.size())));
+    }
+
+    CompactionResult compact(const RetentionPolicy& policy) {
+        namespace fs = std::filesystem;
+        CompactionResult result;
+        size_t inodesBefore = scanUsage(result.bytesBefore, result.indexBytesBefore);
+
+        std::map<std::string, std::map<std::string, fs::path>> loose;
+        std::map<std::string, std::string> heads;
+        for (const auto& hashDir : fs::directory_iterator(versionsDir)) {
+            if (!hashDir.is_directory() || !fs::exists(hashDir.path() / "HEAD")) continue;
+            std::string fileHash = hashDir.path().filename().string();
+            std::ifstream headFile(hashDir.path() / "HEAD");
+            std::getline(headFile, heads[fileHash]);
+            for (const auto& versionDir : fs::directory_iterator(hashDir.path())) {
+                if (!versionDir.is_directory()) continue;
+                for (const auto& file : fs::directory_iterator(versionDir.path())) {
+                    if (file.is_regular_file()) {
+                        loose[fileHash][versionDir.path().filename().string()] = file.path();
+                    }
+                }
+            }
+        }
+
+        std::set<std::string> fileHashes;
+        for (const auto& [fileHash, versions] : entries) fileHashes.insert(fileHash);
+        for (const auto& [fileHash, versions] : loose) fileHashes.insert(fileHash);
+
+        std::string newPackName = "PACK-" + currentTimestamp();
+        std::ofstream newPack(versionsDir / (newPackName + ".tmp"), std::ios::binary);
+        std::ifstream oldPack;
+        if (!packName.empty()) oldPack.open(versionsDir / packName, std::ios::binary);
+        if (!newPack) return result;
+        auto abandon = [&](const std::string& reason) {
+            newPack.close();
+            fs::remove(versionsDir / (newPackName + ".tmp"));
+            throw std::runtime_error(reason);
+        };
+        if (!entries.empty() && !oldPack) abandon("cannot open " + packName);
+
+        std::map<std::string, std::map<std::string, Entry>> newEntries;
+        std::map<std::string, Entry> blobs;
+        uint64_t offset = 0;
+        for (const auto& fileHash : fileHashes) {
+            std::set<std::string> timestamps;
+            for (const auto& [timestamp, entry] : entries[fileHash]) timestamps.insert(timestamp);
+            for (const auto& [timestamp, path] : loose[fileHash]) timestamps.insert(timestamp);
+            std::set<std::string> keep = selectRetained(timestamps, heads[fileHash], policy);
+            result.pruned += timestamps.size() - keep.size();
+
+            for (const auto& timestamp : keep) {
+                std::string content;
+                auto looseVersion = loose[fileHash].find(timestamp);
+                if (looseVersion != loose[fileHash].end()) {
+                    std::ifstream file(looseVersion->second, std::ios::binary);
+                    if (!file) abandon("cannot read " + looseVersion->second.string());
+                    content.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+                    if (file.bad()) abandon("cannot read " + looseVersion->second.string());
+                    ++result.packed;
+                } else {
+                    const Entry& entry = entries[fileHash][timestamp];
+                    content.resize(entry.size);
+                    oldPack.clear();
+                    if (!oldPack.seekg(static_cast<std::streamoff>(entry.offset)) ||
+                        !oldPack.read(content.data(), static_cast<std::streamsize>(content.size())) ||
+                        oldPack.gcount() != static_cast<std::streamsize>(content.size())) {
+                        abandon(packName + " is truncated or unreadable");
+                    }
+                }
+
+                std::string blobHash = contentHash(content);
+                auto blob = blobs.find(blobHash);
+                if (blob == blobs.end()) {
+                    newPack.write(content.data(), static_cast<std::streamsize>(content.size()));
+                    blob = blobs.emplace(blobHash, Entry{blobHash, offset, content.size()}).first;
+                    offset += content.size();
+                }
+                newEntries[fileHash][timestamp] = blob->second;
+            }
+        }
+        newPack.close();
+        if (!newPack) {
+            fs::remove(versionsDir / (newPackName + ".tmp"));
+            return result;
+        }
+        fs::rename(versionsDir / (newPackName + ".tmp"), versionsDir / newPackName);
+
+        std::ofstream index(versionsDir / "PACK.idx.tmp");
+        index << "PACK " << newPackName << "\n";
+        for (const auto& [fileHash, versions] : newEntries) {
+            for (const auto& [timestamp, entry] : versions) {
+                index << fileHash << ' ' << timestamp << ' ' << entry.blobHash << ' ' << entry.offset << ' ' << entry.size << "\n";
+            }
+        }
+        index.close();
+        if (!index) {
+            fs::remove(versionsDir / "PACK.idx.tmp");
+            fs::remove(versionsDir / newPackName);
+            return result;
+        }
+        fs::rename(versionsDir / "PACK.idx.tmp", versionsDir / "PACK.idx");
+
+        std::error_code ec;
+        if (!packName.empty() && packName != newPackName) fs::remove(versionsDir / packName, ec);
+        for (const auto& [fileHash, versions] : loose) {
+            for (const auto& [timestamp, path] : versions) {
+                fs::remove_all(path.parent_path(), ec);
+            }
+        }
+        for (const auto& [fileHash, head] : heads) {
+            if (!newEntries.count(fileHash)) fs::remove_all(versionsDir / fileHash, ec);
+        }
+
+        packName = newPackName;
+        entries = std::move(newEntries);
+        size_t inodesAfter = scanUsage(result.bytesAfter, result.indexBytesAfter);
+        result.inodesFreed = inodesBefore > inodesAfter ? inodesBefore - inodesAfter : 0;
+        return result;
+    }
+
+private:
+    std::filesystem::path versionsDir;
+    std::string packName;
+    std::map<std::string, std::map<std::string, Entry>> entries;
+
+    void loadIndex() {
+        std::ifstream index(versionsDir / "PACK.idx");
+        if (!index) return;
+        std::string tag;
+        index >> tag >> packName;
+        if (tag != "PACK") {
+            packName.clear();
+            return;
+        }
+        std::string fileHash, timestamp;
+        Entry entry;
+        while (index >> fileHash >> timestamp >> entry.blobHash >> entry.offset >> entry.size) {
+            entries[fileHash][timestamp] = entry;
+        }
+    }
+
+    size_t scanUsage(uintmax_t& payloadBytes, uintmax_t& indexBytes) {
+        size_t inodes = 0;
+        payloadBytes = indexBytes = 0;
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(versionsDir, ec)) {
+            ++inodes;
+            if (!entry.is_regular_file(ec)) continue;
+            std::filesystem::path relative = entry.path().lexically_relative(versionsDir);
+            size_t depth = std::distance(relative.begin(), relative.end());
+            bool payload = (depth == 1 && relative.string().rfind("PACK-", 0) == 0) ||
+                           (depth == 3 && relative.begin()->string() != "snapshots");
+            (payload ? payloadBytes : indexBytes) += entry.file_size(ec);
+        }
+        return inodes;
+    }
+
+    static std::string contentHash(const std::string& content) {
+        unsigned char hash[SHA_DIGEST_LENGTH];
+        SHA1(reinterpret_cast<const unsigned char*>(content.data()), content.size(), hash);
+        std::ostringstream oss;
+        for (const auto& byte : hash) {
+            oss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(byte);
+        }
+        return oss.str();
+    }
+
+    static std::string currentTimestamp() {
+        std::time_t timeNow = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+        std::tm tm = *std::localtime(&timeNow);
+        char buffer[20];
+        std::strftime(buffer, sizeof(buffer), "%Y%m%d%H%M%S", &tm);
+        return std::string(buffer);
+    }
+
+    static std::time_t parseTimestamp(const std::string& timestamp) {
+        std::tm tm{};
+        std::istringstream iss(timestamp);
+        iss >> std::get_time(&tm, "%Y%m%d%H%M%S");
+        if (iss.fail()) return 0;
+        tm.tm_isdst = -1;
+        return std::mktime(&tm);
+    }
+
+public:
+    static std::set<std::string> selectRetained(const std::set<std::string>& timestamps, const std::string& head, const RetentionPolicy& policy) {
+        std::set<std::string> keep;
+        std::set<std::string> dailyBuckets, monthlyBuckets;
+        std::time_t now = std::time(nullptr);
+        for (auto it = timestamps.rbegin(); it != timestamps.rend(); ++it) {
+            const std::string& timestamp = *it;
+            double ageHours = std::difftime(now, parseTimestamp(timestamp)) / 3600.0;
+            if (timestamp == head || ageHours <= policy.keepAllHours) {
+                keep.insert(timestamp);
+            } else if (ageHours <= policy.dailyDays * 24.0) {
+                if (dailyBuckets.insert(timestamp.substr(0, 8)).second) keep.insert(timestamp);
+            } else if (policy.monthlyMonths <= 0 || ageHours <= policy.dailyDays * 24.0 + policy.monthlyMonths * 31 * 24.0) {
+                if (monthlyBuckets.insert(timestamp.substr(0, 6)).second) keep.insert(timestamp);
+            }
+        }
+        return keep;
+    }
+};
 
 class VersionManager {
 private:
@@ -43,6 +306,12 @@ public:
 
     ~VersionManager() {}
 
+    static CompactionResult compactDirectory(const std::filesystem::path& directory, const RetentionPolicy& policy = RetentionPolicy()) {
+        std::filesystem::path versionsDir = directory / ".versions";
+        if (!std::filesystem::is_directory(versionsDir)) return CompactionResult();
+        return VersionPack(versionsDir).compact(policy);
+    }
+
     void saveVersion() {
         std::string fileHash = getFileHash(std::filesystem::path(fileName).filename().string());
         std::string timestamp = getCurrentTimestamp();
@@ -71,9 +340,9 @@ public:
     std::vector<std::string> listVersions() {
         std::string fileHash = getFileHash(std::filesystem::path(fileName).filename().string());
         std::filesystem::path versionRoot = fileDirectory / ".versions" / fileHash;
-        std::vector<std::string> timestamps;
+        std::vector<std::string> timestamps = VersionPack(fileDirectory / ".versions").listVersions(fileHash);
         if (!std::filesystem::exists(versionRoot)) {
-            std::cout << "No versions found for " << fileName << "." << std::endl;
+            if (timestamps.empty()) std::cout << "No versions found for " << fileName << "." << std::endl;
             return timestamps;
         }
         for (const auto& entry : std::filesystem::directory_iterator(versionRoot)) {
@@ -81,6 +350,8 @@ public:
                 timestamps.push_back(entry.path().filename().string());
             }
         }
+        std::sort(timestamps.begin(), timestamps.end());
+        timestamps.erase(std::unique(timestamps.begin(), timestamps.end()), timestamps.end());
         return timestamps;
     }
 
@@ -91,9 +362,41 @@ public:
         if (std::filesystem::exists(nativePath)) {
             std::filesystem::create_directories(std::filesystem::path(restoredFile).parent_path());
             std::filesystem::copy(nativePath, restoredFile, std::filesystem::copy_options::overwrite_existing);
+            return;
+        }
+        std::string content;
+        if (VersionPack(fileDirectory / ".versions").read(fileHash, targetVersion, content)) {
+            std::filesystem::create_directories(std::filesystem::path(restoredFile).parent_path());
+            std::ofstream restored(restoredFile, std::ios::binary | std::ios::trunc);
+            restored.write(content.data(), static_cast<std::streamsize>(content.size()));
         } else {
             std::cout << "Version " << targetVersion << " not found!" << std::endl;
         }
     }
+
+    bool readVersion(const std::string& targetVersion, std::vector<std::string>& lines) {
+        std::string fileHash = getFileHash(std::filesystem::path(fileName).filename().string());
+        std::filesystem::path nativePath = fileDirectory / ".versions" / fileHash / targetVersion / std::filesystem::path(fileName).filename();
+        std::string content;
+        std::ifstream file(nativePath, std::ios::binary);
+        if (file) {
+            content.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        } else if (!VersionPack(fileDirectory / ".versions").read(fileHash, targetVersion, content)) {
+            return false;
+        }
+        splitLines(content, lines);
+        return true;
+    }
+
+    static void splitLines(const std::string& content, std::vector<std::string>& lines) {
+        lines.clear();
+        size_t start = 0;
+        while (start < content.size()) {
+            size_t end = content.find('\n', start);
+            if (end == std::string::npos) end = content.size();
+            lines.emplace_back(content, start, end - start);
+            start = end + 1;
+        }
+    }
 };
 #endif
\ No newline at end of file